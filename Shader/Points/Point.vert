@@ -1,7 +1,10 @@
 #version 330 core
-layout(location = 0) in vec4 a_position;
-layout(location = 1) in vec4 a_color;
-layout(location = 2) in vec2 a_texCoord;
+// 紧凑粒子格式（PackedParticles.h）：归一化读取的 16 位定点位置与 8 位着色通道
+layout(location = 0) in vec3 a_position;
+layout(location = 1) in float a_scalar;
+uniform vec3 u_aabbMin;
+uniform vec3 u_aabbExtent;
+uniform vec4 u_scalarRange; // x = 最小值，y = 区间长度
 uniform mat4 projection;
 uniform mat4 model;
 uniform mat4 view;
@@ -10,7 +13,9 @@ out vec4 v_color;
 
 void main() {
     mvp = projection * view * model;
-    gl_Position = mvp * a_position;
-    v_color = a_color;
+    vec3 p = u_aabbMin + a_position * u_aabbExtent;
+    gl_Position = mvp * vec4(p.x, p.y, -p.z, 10.0);
+    float density = u_scalarRange.x + a_scalar * u_scalarRange.y;
+    v_color = vec4(vec3(1.0 - density), 1.0);
     gl_PointSize = 5.0;
 }
\ No newline at end of file
@@ -0,0 +1,311 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+/*
+ * 无窗口的流体批处理程序：按场景、粒子数与步数运行 CPU 求解器（有 OpenGL 上下文时也运行 GPU 求解器），
+ * 输出 JSON 格式的吞吐量报告，用于每晚检查性能回退
+ *
+ * 用法：FluidBatch [--scenario cube|dambreak|pool] [--particles N] [--steps N] [--warmup N]
+ *                  [--threads N] [--seed N] [--viscosity C] [--vorticity EPS] [--pairs] [--pair-cache]
+ *                  [--reorder K] [--tiled] [--no-gpu] [--output report.json]
+ *  --warmup 步不计入统计；--threads 0 表示使用硬件线程数
+ *  --viscosity / --vorticity 开启 XSPH 粘性与涡量约束（默认关闭），耗时计入 epilogue
+ *  --pairs CPU 求解器按邻居对 (i < j) 遍历，每对只计算一次核函数
+ *  --pair-cache 在 lambda 时缓存邻居对的核函数值与梯度，位置增量直接读取（GPU 每个粒子缓存 kGpuPairCacheCapacity 个邻居）
+ *  --reorder GPU 求解器每 K 步把粒子缓冲按网格重排一次（默认 0，关闭）；CPU 求解器固定每 25 步做 Z 序重排
+ *  --tiled GPU 求解器的 lambda / 位置修正使用按网格分块、经共享内存读取邻居的着色器
+ *  不指定 --output 时报告打印到标准输出的最后
+ *
+ * 报告字段：
+ *  stepsPerSecond          每秒步数（CPU 为 runPBF 次数，未开启自适应步长时即子步数）
+ *  particleStepsPerSecond  粒子数 * 每秒步数
+ *  phaseMsPerStep          每步各阶段的平均耗时（毫秒），只有 CPU 求解器提供
+ *  stageMs                 GPU 每个计时阶段（GPU_StageTimer.h）最近若干步的平均值与百分位数（毫秒），
+ *                          只统计执行了该阶段的步（如 --reorder 的重排）
+ *  lastStep                最后一步的求解器统计（StepStats.h），GPU 为最近一次回读完成的一步
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <json.hpp>
+
+#include "Rendering/Assets/fluid/CPU_process/FluidSimulator.h"
+#include "Rendering/Assets/fluid/GPU_process/GPU_FluidSimulator.h"
+#include "Rendering/Assets/fluid/Scenario.h"
+#include "Utils/log.cpp"
+
+using json = nlohmann::ordered_json;
+
+namespace {
+
+constexpr int kGpuPairCacheCapacity = 48; // 覆盖绝大多数粒子的邻居数，100 万粒子约 960 MB
+
+struct Options {
+	scenario::Layout layout = scenario::Layout::DamBreak;
+	int particles = 50000;
+	int steps = 200;
+	int warmup = 10;
+	int threads = 0;
+	uint32_t seed = 0x5eedu;
+	float viscosity = 0.0f;
+	float vorticity = 0.0f;
+	bool symmetricPairs = false;
+	bool pairCache = false;
+	int reorderInterval = 0;
+	bool tiledNeighbours = false;
+	bool gpu = true;
+	std::string output;
+};
+
+void printUsage() {
+	std::cerr << "usage: FluidBatch [--scenario cube|dambreak|pool] [--particles N] [--steps N] [--warmup N]\n"
+	             "                  [--threads N] [--seed N] [--viscosity C] [--vorticity EPS] [--pairs] [--pair-cache]\n"
+	             "                  [--reorder K] [--tiled] [--no-gpu] [--output report.json]\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		// 需要参数值的选项
+		auto value = [&](const char* name) -> const char* {
+			if (arg != name) return nullptr;
+			if (i + 1 >= argc) {
+				std::cerr << name << " requires a value\n";
+				return nullptr;
+			}
+			return argv[++i];
+		};
+		if (arg == "--no-gpu") {
+			options.gpu = false;
+		} else if (arg == "--pairs") {
+			options.symmetricPairs = true;
+		} else if (arg == "--pair-cache") {
+			options.pairCache = true;
+		} else if (arg == "--tiled") {
+			options.tiledNeighbours = true;
+		} else if (arg == "--help" || arg == "-h") {
+			return false;
+		} else if (const char* v = value("--scenario")) {
+			if (!scenario::parseLayout(v, options.layout)) {
+				std::cerr << "unknown scenario: " << v << "\n";
+				return false;
+			}
+		} else if (const char* v = value("--particles")) {
+			options.particles = std::atoi(v);
+		} else if (const char* v = value("--steps")) {
+			options.steps = std::atoi(v);
+		} else if (const char* v = value("--warmup")) {
+			options.warmup = std::atoi(v);
+		} else if (const char* v = value("--threads")) {
+			options.threads = std::atoi(v);
+		} else if (const char* v = value("--seed")) {
+			options.seed = static_cast<uint32_t>(std::strtoul(v, nullptr, 0));
+		} else if (const char* v = value("--viscosity")) {
+			options.viscosity = static_cast<float>(std::atof(v));
+		} else if (const char* v = value("--vorticity")) {
+			options.vorticity = static_cast<float>(std::atof(v));
+		} else if (const char* v = value("--reorder")) {
+			options.reorderInterval = std::atoi(v);
+		} else if (const char* v = value("--output")) {
+			options.output = v;
+		} else {
+			std::cerr << "unknown option: " << arg << "\n";
+			return false;
+		}
+	}
+	if (options.particles <= 0 || options.steps <= 0 || options.warmup < 0) {
+		std::cerr << "--particles and --steps must be positive\n";
+		return false;
+	}
+	if (options.reorderInterval < 0) {
+		std::cerr << "--reorder must not be negative\n";
+		return false;
+	}
+	return true;
+}
+
+json throughput(const Options& options, double seconds) {
+	const double stepsPerSecond = options.steps / seconds;
+	return {{"seconds", seconds},
+	        {"stepsPerSecond", stepsPerSecond},
+	        {"particleStepsPerSecond", stepsPerSecond * options.particles}};
+}
+
+// GPU 各阶段的滚动统计；只列出执行过的阶段
+json stageJson(const GPU_StageTimer& timer) {
+	json stages = json::object();
+	for (int s = 0; s < static_cast<int>(GPU_Stage::Count); s++) {
+		const auto stage = static_cast<GPU_Stage>(s);
+		const GPU_StageSummary summary = timer.summary(stage);
+		if (summary.samples == 0) continue;
+		stages[gpuStageName(stage)] = {{"samples", summary.samples},
+		                               {"avg", summary.avgMs},
+		                               {"p50", summary.p50Ms},
+		                               {"p95", summary.p95Ms},
+		                               {"p99", summary.p99Ms},
+		                               {"max", summary.maxMs}};
+	}
+	return stages;
+}
+
+// 最后一步的求解器统计
+json statsJson(const StepStats& stats) {
+	return {{"step", stats.step},
+	        {"iterations", stats.iterations},
+	        {"warmStartPasses", stats.warmStartPasses},
+	        {"densityErrorMax", stats.densityErrorMax},
+	        {"densityErrorAvg", stats.densityErrorAvg},
+	        {"neighbourHistogram", stats.neighbourHistogram},
+	        {"truncatedParticles", stats.truncatedParticles},
+	        {"droppedNeighbours", stats.droppedNeighbours},
+	        {"cellOverflows", stats.cellOverflows},
+	        {"occupiedCells", stats.occupiedCells},
+	        {"maxCellOccupancy", stats.maxCellOccupancy}};
+}
+
+json runCPU(const Options& options) {
+	Simulator sim;
+	sim.setThreadNums(options.threads);
+	sim.setSeed(options.seed);
+	sim.setXSPHViscosity(options.viscosity);
+	sim.setVorticityConfinement(options.vorticity);
+	sim.setSymmetricPairs(options.symmetricPairs);
+	sim.setPairCache(options.pairCache);
+	const Eigen::Vector3f boundary = sim.getBoundingBox();
+	sim.init(scenario::generate(options.layout, options.particles, Eigen::Vector3f::Zero(), boundary, options.seed));
+
+	for (int i = 0; i < options.warmup; i++) sim.runPBF();
+	sim.resetPhaseTimings();
+	const auto begin = std::chrono::steady_clock::now();
+	for (int i = 0; i < options.steps; i++) sim.runPBF();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	const auto& t = sim.getPhaseTimings();
+	const double msPerStep = 1000.0 / static_cast<double>(std::max<uint64_t>(t.steps, 1));
+	json report = throughput(options, seconds);
+	report["threads"] = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+	report["substeps"] = t.steps;
+	report["symmetricPairs"] = options.symmetricPairs;
+	report["pairCache"] = options.pairCache;
+	report["phaseMsPerStep"] = {{"reorder", t.reorder * msPerStep},
+	                            {"prologue", t.prologue * msPerStep},
+	                            {"lambda", t.lambda * msPerStep},
+	                            {"delta", t.delta * msPerStep},
+	                            {"epilogue", t.epilogue * msPerStep}};
+	report["lastStep"] = statsJson(sim.getStepStats());
+	return report;
+}
+
+// 用不可见的窗口创建 OpenGL 上下文；没有显示设备或驱动不支持 4.5 时返回 nullptr
+GLFWwindow* createHiddenContext(std::string& error) {
+	if (!glfwInit()) {
+		error = "glfwInit failed";
+		return nullptr;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(1, 1, "FluidBatch", nullptr, nullptr);
+	if (!window) {
+		error = "no OpenGL 4.5 context";
+		glfwTerminate();
+		return nullptr;
+	}
+	glfwMakeContextCurrent(window);
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		error = "gladLoadGLLoader failed";
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return nullptr;
+	}
+	return window;
+}
+
+json runGPU(const Options& options) {
+	std::string error;
+	GLFWwindow* window = createHiddenContext(error);
+	if (!window) {
+		LOG_WARNING << "FluidBatch: skip GPU solver, " << error;
+		return {{"available", false}, {"reason", error}};
+	}
+	json report;
+	{
+		// 析构时删除 GL 对象，必须在销毁上下文之前
+		GPU_FluidSimulator sim(options.particles);
+		sim.setScenario(options.layout);
+		sim.setXSPHViscosity(options.viscosity);
+		sim.setVorticityConfinement(options.vorticity);
+		sim.setPairCache(options.pairCache ? kGpuPairCacheCapacity : 0);
+		sim.setReorderInterval(options.reorderInterval);
+		sim.setTiledNeighbours(options.tiledNeighbours);
+		sim.onAttach();
+		sim.onStart();
+		for (int i = 0; i < options.warmup; i++) sim.Update(0.0f);
+		glFinish();
+		sim.getStageTimer().poll();
+		sim.getStageTimer().reset(); // 阶段统计不含预热步
+		const auto begin = std::chrono::steady_clock::now();
+		for (int i = 0; i < options.steps; i++) sim.Update(0.0f);
+		glFinish(); // 等 GPU 执行完再计时
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		sim.getStageTimer().poll(); // 收回最后几步的时间戳
+		report = throughput(options, seconds);
+		report["available"] = true;
+		report["pairCacheCapacity"] = options.pairCache ? kGpuPairCacheCapacity : 0;
+		report["reorderInterval"] = options.reorderInterval;
+		report["tiledNeighbours"] = options.tiledNeighbours;
+		report["renderer"] = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		report["stageMs"] = stageJson(sim.getStageTimer());
+		report["droppedTimingFrames"] = sim.getStageTimer().droppedFrames();
+		report["lastStep"] = statsJson(sim.getStepStats()); // 异步回读，对应的是几步之前
+	}
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return report;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	Options options;
+	if (!parseOptions(argc, argv, options)) {
+		printUsage();
+		return 2;
+	}
+
+	json report;
+	report["scenario"] = scenario::layoutName(options.layout);
+	report["particles"] = options.particles;
+	report["steps"] = options.steps;
+	report["warmup"] = options.warmup;
+	report["seed"] = options.seed;
+	report["viscosity"] = options.viscosity;
+	report["vorticity"] = options.vorticity;
+	report["cpu"] = runCPU(options);
+	if (options.gpu) {
+		report["gpu"] = runGPU(options);
+	}
+
+	const std::string text = report.dump(2);
+	if (options.output.empty()) {
+		std::cout << text << std::endl;
+		return 0;
+	}
+	std::ofstream out(options.output);
+	if (!(out << text << '\n')) {
+		LOG_ERROR << "FluidBatch: cannot write " << options.output;
+		return 1;
+	}
+	return 0;
+}
@@ -24,12 +24,13 @@ struct alignas(16) Vertex {
 	Eigen::Vector4f position;
 	Eigen::Vector2f texCoord;
 
-	static Vertex particlesToVertex(Particle particle){
+	static Vertex particlesToVertex(const ParticleView& particles, std::size_t i){
+		const float density = particles.density[i];
 //		return {Eigen::Vector4f(fabs(particle.vel.x()), fabs(particle.vel.y()), fabs(particle.vel.z()), 255.0f),
-		return {Eigen::Vector4f(1-particle.density, 1-particle.density, 1-particle.density, 1.0f),
+		return {Eigen::Vector4f(1-density, 1-density, 1-density, 1.0f),
 //		return {(particle.vel.y() > 0) ? Eigen::Vector4f(1.0f, 0.0f, 0.0f, 1.0f): Eigen::Vector4f(0.0f, 1.0f, 0.0f, 1.0f),
 //		return {Eigen::Vector4f(0x66 / 255.0, 0xcc / 255.0, 0xff / 255.0, 1.0f),
-					  Eigen::Vector4f(particle.pos.x(), particle.pos.y(), -particle.pos.z(), 10.0f),
+					  Eigen::Vector4f(particles.x[i], particles.y[i], -particles.z[i], 10.0f),
 					  Eigen::Vector2f(0, 0)};
 	}
 };
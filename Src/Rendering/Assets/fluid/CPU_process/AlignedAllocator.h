@@ -0,0 +1,45 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_ALIGNEDALLOCATOR_H
+#define LEARNOPENGL_ALIGNEDALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+ * @brief: 按 Align 字节对齐的分配器，供 SoA 粒子数组使用
+ * 64 字节同时满足 cache line 与 AVX-512 load/store 的对齐要求
+ */
+template<typename T, std::size_t Align = 64>
+struct AlignedAllocator {
+	using value_type = T;
+
+	template<typename U>
+	struct rebind {
+		using other = AlignedAllocator<U, Align>;
+	};
+
+	AlignedAllocator() noexcept = default;
+	template<typename U>
+	AlignedAllocator(const AlignedAllocator<U, Align>&) noexcept {}
+
+	T* allocate(std::size_t n) {
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+	}
+	void deallocate(T* p, std::size_t) noexcept {
+		::operator delete(p, std::align_val_t(Align));
+	}
+
+	template<typename U>
+	bool operator==(const AlignedAllocator<U, Align>&) const noexcept { return true; }
+	template<typename U>
+	bool operator!=(const AlignedAllocator<U, Align>&) const noexcept { return false; }
+};
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+#endif //LEARNOPENGL_ALIGNEDALLOCATOR_H
@@ -0,0 +1,31 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_BOUNDARYPOLICY_H
+#define LEARNOPENGL_BOUNDARYPOLICY_H
+
+/*
+ * 边界处理策略，作为 BasicSimulator 的模板参数
+ *  margin(h)  边界向内收缩的距离
+ *  jitter     越界粒子是否加 [0, epsilon) 的随机抖动，防止粒子重叠在同一平面上
+ */
+namespace sph {
+
+// 夹到 [0, boundary] 内并加抖动（CPU 求解器原来的做法）
+struct ClampBoundary {
+	static constexpr const char* name = "clamp + jitter";
+	static constexpr float margin(float) { return 0.0f; }
+	static constexpr bool jitter = true;
+};
+
+// 夹到向内收缩 0.5h 的盒子内，不加抖动（与 GPU 着色器 fluidCommon.glsl 中的 confine 一致）
+struct MarginBoundary {
+	static constexpr const char* name = "margin clamp";
+	static constexpr float margin(float h) { return 0.5f * h; }
+	static constexpr bool jitter = false;
+};
+
+} // namespace sph
+
+#endif //LEARNOPENGL_BOUNDARYPOLICY_H
@@ -0,0 +1,46 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "CellHashTable.h"
+
+#include <algorithm>
+#include <bit>
+
+void CellHashTable::reserve(std::size_t cells) {
+	const std::size_t slots = std::bit_ceil(std::max<std::size_t>(cells * 2, 64));
+	keys.assign(slots, kEmptyKey);
+	cellStart.assign(slots, 0);
+	cellEnd.assign(slots, 0);
+	occupied.clear();
+	occupied.reserve(slots / 2);
+}
+
+void CellHashTable::clear() {
+	for (uint32_t s : occupied) {
+		keys[s] = kEmptyKey;
+		cellStart[s] = cellEnd[s] = 0;
+	}
+	occupied.clear();
+}
+
+uint32_t CellHashTable::insert(uint64_t key, uint32_t hash) {
+	const std::size_t mask = keys.size() - 1;
+	for (std::size_t s = hash & mask;; s = (s + 1) & mask) {
+		if (keys[s] == key) return static_cast<uint32_t>(s);
+		if (keys[s] == kEmptyKey) {
+			if (occupied.size() * 2 >= keys.size()) return kNone; // 负载超过 1/2，探测链会变长
+			keys[s] = key;
+			occupied.push_back(static_cast<uint32_t>(s));
+			return static_cast<uint32_t>(s);
+		}
+	}
+}
+
+uint32_t CellHashTable::find(uint64_t key, uint32_t hash) const {
+	const std::size_t mask = keys.size() - 1;
+	for (std::size_t s = hash & mask;; s = (s + 1) & mask) {
+		if (keys[s] == key) return static_cast<uint32_t>(s);
+		if (keys[s] == kEmptyKey) return kNone;
+	}
+}
@@ -0,0 +1,66 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_CELLHASHTABLE_H
+#define LEARNOPENGL_CELLHASHTABLE_H
+
+#include <cstdint>
+#include <vector>
+
+/*
+ * 稀疏网格索引：开放寻址（线性探测）哈希表，键为网格坐标，值为网格在 cellParticles 中的区间
+ *  只存放非空网格，内存与每帧的重置代价都与非空网格数成正比，与场景包围盒大小无关
+ *  槽数为 2 的幂，负载不超过 1/2；插入超过负载上限时返回 kNone，由调用方扩容后重建
+ */
+namespace cellhash {
+
+constexpr int kBitsPerAxis = 21;            // 3 * 21 = 63 位
+constexpr int kBias = 1 << (kBitsPerAxis - 1); // 每轴可表示 [-2^20, 2^20) 个网格
+constexpr uint64_t kAxisMask = (1ull << kBitsPerAxis) - 1;
+
+// 网格坐标打包成 63 位键，最高位恒为 0，所以 ~0 可以作为空槽标记
+constexpr uint64_t packCell(int x, int y, int z) {
+	return (static_cast<uint64_t>(x + kBias) & kAxisMask) << (2 * kBitsPerAxis) |
+	       (static_cast<uint64_t>(y + kBias) & kAxisMask) << kBitsPerAxis |
+	       (static_cast<uint64_t>(z + kBias) & kAxisMask);
+}
+
+// 32 位网格哈希，与 fluidCommon.glsl 中的 hashCell() 逐位一致
+constexpr uint32_t hashCell(int x, int y, int z) {
+	uint32_t h = static_cast<uint32_t>(x) * 0x8da6b343u ^ static_cast<uint32_t>(y) * 0xd8163841u ^
+	             static_cast<uint32_t>(z) * 0xcb1ab31fu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+} // namespace cellhash
+
+struct CellHashTable {
+	static constexpr uint32_t kNone = 0xffffffffu;
+	static constexpr uint64_t kEmptyKey = ~0ull;
+
+	std::vector<uint64_t> keys;               // 每个槽的网格键，kEmptyKey 表示空槽
+	std::vector<uint32_t> cellStart, cellEnd; // 槽 s 对应网格内的粒子为 cellParticles[cellStart[s], cellEnd[s])
+	std::vector<uint32_t> occupied;           // 非空槽，按插入顺序
+
+	void reserve(std::size_t cells); // 保证至少能放下 cells 个网格，会清空表
+	void clear();                    // 只重置非空槽
+
+	/*
+	 * @brief: 查找网格所在的槽，不存在时插入
+	 * @return: 槽下标；表已达到负载上限时返回 kNone
+	 */
+	uint32_t insert(uint64_t key, uint32_t hash);
+	// 网格所在的槽，不存在时返回 kNone
+	[[nodiscard]] uint32_t find(uint64_t key, uint32_t hash) const;
+
+	[[nodiscard]] std::size_t capacity() const { return keys.size(); }
+	[[nodiscard]] std::size_t size() const { return occupied.size(); }
+};
+
+#endif //LEARNOPENGL_CELLHASHTABLE_H
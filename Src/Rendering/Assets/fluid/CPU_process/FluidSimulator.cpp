@@ -1,13 +1,21 @@
 ﻿#include "FluidSimulator.h"
 
+#include "MortonOrder.h"
+#include "Rendering/Assets/fluid/Checkpoint.h"
+#include "Rendering/Assets/fluid/FrameExporter.h"
 #include "Utils/log.cpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
 #include <cmath>
-#include <random>
+#include <cstring>
+#include <numeric>
+#include "Utils/CounterRNG.h"
 
-
-#define PI 3.14159265358979323846
-
-Simulator::Simulator(int particleNums) {
+template <class Kernel, class Boundary>
+BasicSimulator<Kernel, Boundary>::BasicSimulator(int particleNums) {
   LOG_INFO << "FluidSimulator init";
   init(particleNums);
 }
@@ -20,182 +28,914 @@ struct glm_ivec3_hash {
            std::hash<int>()(v.z());
   }
 };
+
+// 快照中各 float 属性的块编号
+std::array<std::pair<checkpoint::BlockId, AlignedVector<float> *>, 12>
+checkpointBlocks(ParticleStore &particles) {
+  return {{
+      {checkpoint::kBlockPosX, &particles.x},
+      {checkpoint::kBlockPosY, &particles.y},
+      {checkpoint::kBlockPosZ, &particles.z},
+      {checkpoint::kBlockVelX, &particles.vx},
+      {checkpoint::kBlockVelY, &particles.vy},
+      {checkpoint::kBlockVelZ, &particles.vz},
+      {checkpoint::kBlockOldX, &particles.oldX},
+      {checkpoint::kBlockOldY, &particles.oldY},
+      {checkpoint::kBlockOldZ, &particles.oldZ},
+      {checkpoint::kBlockLambda, &particles.lambda},
+      {checkpoint::kBlockDensity, &particles.density},
+      {checkpoint::kBlockVorticity, &particles.vorticity},
+  }};
+}
 } // namespace
 
-Eigen::Vector3i Simulator::getCell(Eigen::Vector3f pos) {
-  return Eigen::Vector3i{static_cast<int>(pos.x() * cellRecpr),
-                         static_cast<int>(pos.y() * cellRecpr),
-                         static_cast<int>(pos.z() * cellRecpr)};
+template <class Kernel, class Boundary>
+Eigen::Vector3i
+BasicSimulator<Kernel, Boundary>::getCell(Eigen::Vector3f pos) {
+  // 向下取整，负坐标的网格也与正坐标一样宽
+  return Eigen::Vector3i{static_cast<int>(std::floor(pos.x() * cellRecpr)),
+                         static_cast<int>(std::floor(pos.y() * cellRecpr)),
+                         static_cast<int>(std::floor(pos.z() * cellRecpr))};
 }
-int Simulator::roundUp(float val, float step) {
-  return static_cast<int>(std::floor(val * cellRecpr / step + 1) * step);
+template <class Kernel, class Boundary>
+ParticleView BasicSimulator<Kernel, Boundary>::getParticles() const {
+  return {particles.x,      particles.y,       particles.z,
+          particles.vx,     particles.vy,      particles.vz,
+          particles.lambda, particles.density, particles.id};
 }
-const std::vector<Particle> &Simulator::getParticles() { return particles; }
 // const Particle* Simulator::getParticles() {
 //	return particles;
 // }
 // const int Simulator::getParticleNums() {
 //	return particleNums;
 // }
-Eigen::Vector3f Simulator::confineParticle(Eigen::Vector3f pos) {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<float> dis(
-      0.0f, epsilon); // 创建一个随机数生成器, 范围在0到1e-5之间
-  Eigen::Vector3f minBound = Eigen::Vector3f(0, 0, 0);
-  Eigen::Vector3f maxBound =
-      Eigen::Vector3f(boundary.x(), boundary.y(), boundary.z());
+template <class Kernel, class Boundary>
+Eigen::Vector3f
+BasicSimulator<Kernel, Boundary>::confineParticle(Eigen::Vector3f pos,
+                                                  uint32_t id,
+                                                  uint32_t stream) {
+  constexpr float margin = Boundary::margin(h);
+  const Eigen::Vector3f minBound = Eigen::Vector3f::Constant(margin);
+  const Eigen::Vector3f maxBound =
+      boundary - Eigen::Vector3f::Constant(margin);
+  if constexpr (!Boundary::jitter) {
+    return pos.cwiseMax(minBound).cwiseMin(maxBound);
+  }
+  // 绝大多数粒子不在边界外，直接返回，不生成随机数
+  if ((pos.array() >= minBound.array()).all() &&
+      (pos.array() <= maxBound.array()).all())
+    return pos;
+  // 每个轴一个 [0, epsilon) 的抖动量
+  const auto r = crng::uniform4(id, static_cast<uint32_t>(stepCount), stream,
+                                seed);
   if (pos.x() < minBound.x())
-    pos.x() = minBound.x() + dis(gen);
+    pos.x() = minBound.x() + r[0] * epsilon;
   if (pos.y() < minBound.y())
-    pos.y() = minBound.y() + dis(gen);
+    pos.y() = minBound.y() + r[1] * epsilon;
   if (pos.z() < minBound.z())
-    pos.z() = minBound.z() + dis(gen);
+    pos.z() = minBound.z() + r[2] * epsilon;
   if (pos.x() > maxBound.x())
-    pos.x() = maxBound.x() - dis(gen);
+    pos.x() = maxBound.x() - r[0] * epsilon;
   if (pos.y() > maxBound.y())
-    pos.y() = maxBound.y() - dis(gen);
+    pos.y() = maxBound.y() - r[1] * epsilon;
   if (pos.z() > maxBound.z())
-    pos.z() = maxBound.z() - dis(gen);
+    pos.z() = maxBound.z() - r[2] * epsilon;
   return pos;
 }
-bool Simulator::isInRange(const Eigen::Vector3i &cell) {
-  return cell.x() >= 0 && cell.x() < gridSize.x() && cell.y() >= 0 &&
-         cell.y() < gridSize.y() && cell.z() >= 0 && cell.z() < gridSize.z();
+template <class Kernel, class Boundary>
+uint32_t BasicSimulator<Kernel, Boundary>::findCell(
+    const Eigen::Vector3i &cell) const {
+  return cells.find(cellhash::packCell(cell.x(), cell.y(), cell.z()),
+                    cellhash::hashCell(cell.x(), cell.y(), cell.z()));
 }
-float Simulator::poly6Value(float r, float h) { // 计算核函数
+template <class Kernel, class Boundary>
+float BasicSimulator<Kernel, Boundary>::kernelValue(
+    float r) const { // 计算核函数
   if (0 >= r || r >= h)
     return 0.0f;
-  const float ploy6Factor = 315.0f / 64.0f / PI;
-  const float x = (h * h - r * r) / h * h * h;
-  return ploy6Factor * x * x * x;
+  return Kernel::w(r, r * r);
+}
+template <class Kernel, class Boundary>
+Eigen::Vector3f
+BasicSimulator<Kernel, Boundary>::kernelGradient(const Eigen::Vector3f &s,
+                                                 float r) const {
+  if (0 >= r || r >= h)
+    return Eigen::Vector3f::Zero();
+  return s * Kernel::gradFactor(r);
+}
+template <class Kernel, class Boundary>
+sph::KernelConstants
+BasicSimulator<Kernel, Boundary>::kernelConstants() const {
+  const float cutoff = std::min(h, neighbourRadius);
+  sph::KernelConstants k{};
+  k.h = h;
+  k.h2 = h * h;
+  k.cutoff2 = cutoff * cutoff;
+  // 人工压力 scorr = -corrK * (W / W(Δq))^4，Δq = corrDeltaQCooff * h
+  const float deltaQ = corrDeltaQCooff * h;
+  k.scorrK = -corrK;
+  k.invRefPoly6 = 1.0f / Kernel::w(deltaQ, deltaQ * deltaQ);
+  // 只有 poly6/spiky 有 SIMD 实现，需要这两个系数
+  if constexpr (requires { Kernel::poly6Coeff; }) {
+    k.poly6Coeff = Kernel::poly6Coeff;
+    k.spikyCoeff = Kernel::spikyCoeff;
+  }
+  return k;
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setSimdLevel(
+    sph::SimdLevel maxLevel) {
+  kernels = &Kernel::dispatch(maxLevel);
+  LOG_INFO << "SPH kernels: " << sph::simdLevelName(kernels->level);
 }
 
 // ----------- PBF -----------
-void Simulator::init(int particleNums) {
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_real_distribution<float> dis(
-      -0.25f, 0.25f); // 创建一个随机数生成器, 范围在-0.25到0.25之间
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::init(int particleNums) {
   LOG_INFO << "FluidSimulator init";
   Eigen::Vector3f initPos = Eigen::Vector3f(10.0f, 2.0f, 10.0f);
-  LOG_INFO << "boundary = " << boundary << ", grid = " << gridSize
-           << ", cellSize = " << cellSize << ". ";
+  LOG_INFO << "boundary = " << boundary << ", cellSize = " << cellSize
+           << ". ";
   float CubeSize = std::ceil(pow(particleNums, 1.0f / 3.0f));
   float spacing = 1.0f;
   int numPerRow = (int)(CubeSize / spacing) + 1;
   int numPerFloor = numPerRow * numPerRow;
+  std::vector<Eigen::Vector3f> positions;
+  positions.reserve(particleNums);
   for (int i = 0; i < particleNums; i++) {
     int floor = i / numPerFloor;
     int row = (i % numPerFloor) / numPerRow;
     int col = (i % numPerFloor) % numPerRow;
+    // 抖动范围在-0.25到0.25之间
+    const auto r = crng::uniform4(static_cast<uint32_t>(i), 0u,
+                                  crng::kStreamInit, seed);
     Eigen::Vector3f pos =
-        Eigen::Vector3f(static_cast<float>(col) * spacing + dis(gen),
-                        static_cast<float>(floor) * spacing + dis(gen),
-                        static_cast<float>(row) * spacing + dis(gen)) +
+        Eigen::Vector3f(static_cast<float>(col) * spacing + r[0] * 0.5f - 0.25f,
+                        static_cast<float>(floor) * spacing + r[1] * 0.5f - 0.25f,
+                        static_cast<float>(row) * spacing + r[2] * 0.5f - 0.25f) +
         initPos;
-    particles.emplace_back(pos);
+    positions.push_back(pos);
     //		particles[++(Simulator::particleNums)] = Particle(pos);
     //		LOG_INFO << "pointer: " << &(particles.back());
   }
   LOG_INFO << "row: " << numPerRow << ", col: " << numPerRow
            << ", floor: " << numPerFloor;
+  init(positions);
   LOG_INFO << "Init particle nums is " << particleNums << ". "
            << "Finished init.";
 }
-void Simulator::runPBF() {
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::init(
+    const std::vector<Eigen::Vector3f> &positions) {
+  particles.clear();
+  stepCount = 0;
+  resetPhaseTimings();
+  stepStats = StepStats();
+  particles.reserve(positions.size());
+  allocateBuffers(positions.size());
+  for (const Eigen::Vector3f &pos : positions) {
+    particles.push_back(pos);
+  }
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::allocateBuffers(
+    std::size_t particleNums) {
+  neighbours.reserve(particleNums, neighbourCapacity());
+  neighboursValid = false;
+  pairCacheValid = false;
+  buildX.resize(particleNums);
+  buildY.resize(particleNums);
+  buildZ.resize(particleNums);
+  // 网格索引在这里预留，之后每帧复用，非空网格超过容量时在 buildGrid 中扩容
+  cells.reserve(std::max<std::size_t>(particleNums / 8, 1));
+  cellParticles.resize(particleNums);
+  particleCell.resize(particleNums);
+  particleCellKey.resize(particleNums);
+  particleCellHash.resize(particleNums);
+  neighbourCount.resize(particleNums);
+  deltaX.resize(particleNums);
+  deltaY.resize(particleNums);
+  deltaZ.resize(particleNums);
+  vorticityNext.resize(particleNums);
+  neighbourHalf.resize(particleNums);
+  pairGradSq.resize(particleNums);
+  if (!pool) {
+    pool = std::make_unique<ThreadPool>(threadNums);
+  }
+}
+template <class Kernel, class Boundary>
+bool BasicSimulator<Kernel, Boundary>::save(const std::string &path) const {
+  checkpoint::FileHeader header;
+  header.particleCount = particles.size();
+  header.stepCount = static_cast<uint64_t>(stepCount);
+  header.solver = checkpoint::kSolverCPU;
+  header.seed = seed;
+  header.pbfNumIters = static_cast<uint32_t>(pbfNumIters);
+  header.dt = dt;
+  header.h = h;
+  header.mass = mass;
+  header.rho = rho;
+  header.lambdaEpsilon = lambdaEpsilon;
+  header.neighbourRadius = neighbourRadius;
+  header.cellSize = cellSize;
+  for (int a = 0; a < 3; a++) {
+    header.boundaryMin[a] = 0.0f;
+    header.boundaryMax[a] = boundary[a];
+  }
+  checkpoint::Writer writer(header);
+  const std::size_t n = particles.size();
+  for (const auto &[id, array] :
+       checkpointBlocks(const_cast<ParticleStore &>(particles))) {
+    writer.addBlock(id, array->data(), sizeof(float), n);
+  }
+  writer.addBlock(checkpoint::kBlockId, particles.id.data(), sizeof(uint32_t),
+                  n);
+  return writer.write(path);
+}
+template <class Kernel, class Boundary>
+bool BasicSimulator<Kernel, Boundary>::load(const std::string &path) {
+  checkpoint::Reader reader;
+  if (!reader.open(path)) {
+    return false;
+  }
+  const checkpoint::FileHeader &header = reader.header();
+  if (header.solver != checkpoint::kSolverCPU) {
+    LOG_ERROR << "checkpoint " << path << " was written by the GPU solver";
+    return false;
+  }
+  if (header.h != h) {
+    LOG_WARNING << "checkpoint " << path << " uses h = " << header.h
+                << ", current kernel uses h = " << h;
+  }
+  // CPU 求解器的模拟区域固定从原点开始
+  if (header.boundaryMin[0] != 0.0f || header.boundaryMin[1] != 0.0f ||
+      header.boundaryMin[2] != 0.0f) {
+    LOG_ERROR << "checkpoint " << path
+              << " has a boundary that does not start at the origin";
+    return false;
+  }
+  if (!(header.neighbourRadius > 0.0f) ||
+      header.cellSize < header.neighbourRadius) {
+    LOG_ERROR << "checkpoint " << path << " has an invalid grid: radius "
+              << header.neighbourRadius << ", cellSize " << header.cellSize;
+    return false;
+  }
+  const std::size_t n = header.particleCount;
+  const auto floatBlocks = checkpointBlocks(particles);
+  // 先确认所有块都存在，避免只恢复了一部分属性
+  for (const auto &[id, array] : floatBlocks) {
+    if (!reader.block<float>(id)) {
+      LOG_ERROR << "checkpoint " << path << " is missing block " << id;
+      return false;
+    }
+  }
+  const uint32_t *ids = reader.block<uint32_t>(checkpoint::kBlockId);
+  if (!ids) {
+    LOG_ERROR << "checkpoint " << path << " is missing particle ids";
+    return false;
+  }
+  particles.resize(n);
+  for (const auto &[id, array] : floatBlocks) {
+    std::memcpy(array->data(), reader.block<float>(id), n * sizeof(float));
+  }
+  std::memcpy(particles.id.data(), ids, n * sizeof(uint32_t));
+  // 区域与网格参数决定邻居数上限，需要在分配缓冲之前恢复
+  boundary = Eigen::Vector3f(header.boundaryMax[0], header.boundaryMax[1],
+                             header.boundaryMax[2]);
+  neighbourRadius = header.neighbourRadius;
+  cellSize = header.cellSize;
+  cellRecpr = 1.0f / cellSize;
+  neighbourSkin = std::clamp(neighbourSkin, 0.0f, cellSize - neighbourRadius);
+  allocateBuffers(n);
+  stepCount = static_cast<int>(header.stepCount);
+  seed = header.seed;
+  pbfNumIters = static_cast<int>(header.pbfNumIters);
+  dt = header.dt;
+  mass = header.mass;
+  rho = header.rho;
+  lambdaEpsilon = header.lambdaEpsilon;
+  LOG_INFO << "Loaded " << n << " particles at step " << stepCount << " from "
+           << path;
+  return true;
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::runPBF() {
+  if (!adaptiveDt) {
+    step();
+    lastSubsteps = 1;
+    exportFrame();
+    return;
+  }
+  // 每个子步开始前按当前最大速度重新选取 dt，直到覆盖 frameTime
+  float remaining = frameTime;
+  int substeps = 0;
+  while (remaining > 0.0f && substeps < maxSubsteps) {
+    const int left = maxSubsteps - substeps;
+    float stepDt = std::max(cflTimestep(), remaining / static_cast<float>(left));
+    // 避免最后剩下一个很短的子步：剩余时间不足两个子步时平分
+    if (stepDt < remaining && remaining < 2.0f * stepDt) {
+      stepDt = 0.5f * remaining;
+    }
+    dt = std::min(stepDt, remaining);
+    step();
+    remaining -= dt;
+    substeps++;
+  }
+  lastSubsteps = substeps;
+  exportFrame();
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::exportFrame() {
+  if (!frameExporter || !frameExporter->shouldCapture()) {
+    return;
+  }
+  std::unique_ptr<ExportFrame> frame = frameExporter->acquireFrame();
+  if (!frame) {
+    return; // 排队的帧已满，跳过这一帧
+  }
+  // 只在求解器线程做一次拷贝，量化与编码在导出器的后台线程进行
+  const std::size_t n = particles.size();
+  frame->resize(n, true);
+  frame->step = static_cast<uint64_t>(stepCount);
+  std::copy_n(particles.x.data(), n, frame->x.data());
+  std::copy_n(particles.y.data(), n, frame->y.data());
+  std::copy_n(particles.z.data(), n, frame->z.data());
+  std::copy_n(particles.vx.data(), n, frame->vx.data());
+  std::copy_n(particles.vy.data(), n, frame->vy.data());
+  std::copy_n(particles.vz.data(), n, frame->vz.data());
+  std::copy_n(particles.density.data(), n, frame->density.data());
+  std::copy_n(particles.id.data(), n, frame->id.data());
+  frameExporter->submit(std::move(frame));
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setDensityTolerance(float tolerance) {
+  densityTolerance = std::max(tolerance, 0.0f);
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setWarmStart(bool enable) {
+  warmStart = enable;
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setXSPHViscosity(float c) {
+  xsphViscosity = std::max(c, 0.0f);
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setVorticityConfinement(
+    float eps) {
+  vorticityEpsilon = std::max(eps, 0.0f);
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setAdaptiveTimestep(bool enable,
+                                                           float frameTime,
+                                                           float cfl,
+                                                           int maxSubsteps) {
+  adaptiveDt = enable;
+  this->frameTime = frameTime;
+  cflNumber = cfl;
+  this->maxSubsteps = std::max(1, maxSubsteps);
+  if (!enable) {
+    dt = frameTime;
+  }
+}
+template <class Kernel, class Boundary>
+float BasicSimulator<Kernel, Boundary>::maxSpeed() {
+  return std::sqrt(parallelMax([this](std::size_t i) {
+    return particles.vx[i] * particles.vx[i] +
+           particles.vy[i] * particles.vy[i] +
+           particles.vz[i] * particles.vz[i];
+  }));
+}
+template <class Kernel, class Boundary>
+float BasicSimulator<Kernel, Boundary>::cflTimestep() {
+  // 速度项：dt <= cfl * h / vmax；重力项：静止粒子在 dt 内下落不超过 cfl * h
+  const float vmax = maxSpeed();
+  const float velocityDt = vmax > 0.0f ? cflNumber * h / vmax : frameTime;
+  const float forceDt = cflNumber * std::sqrt(h / 9.8f);
+  return std::min(velocityDt, forceDt);
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::step() {
+  using Clock = std::chrono::steady_clock;
+  // 累加从 t 到现在的时间，并把 t 移到现在
+  auto lap = [](Clock::time_point &t, double &total) {
+    const Clock::time_point now = Clock::now();
+    total += std::chrono::duration<double>(now - t).count();
+    t = now;
+  };
+  PhaseTimings times;
+  times.steps = 1;
+  Clock::time_point t = Clock::now();
+  if (reorderInterval > 0 && stepCount % reorderInterval == 0) {
+    reorderParticles(); // 邻居表与网格都在 prologue 中重建，所以在这里重排
+  }
+  lap(t, times.reorder);
   prologue();
+  lap(t, times.prologue);
+  // lambda 保留自上一步，先用它修正一次位置；init 之后的第一步 lambda 全为 0，只会施加 scorr，跳过
+  const bool warmStartPass = warmStart && stepCount > 0;
+  if (warmStartPass) {
+    applyDelta();
+    lap(t, times.delta);
+  }
+  lastIterations = 0;
   for (int i = 1; i <= pbfNumIters; i++) {
-    update();
+    lastDensityError = computeLambda();
+    lap(t, times.lambda);
+    // 已经收敛时不必再修正位置
+    if (densityTolerance > 0.0f && lastDensityError.avg <= densityTolerance) {
+      break;
+    }
+    applyDelta();
+    lap(t, times.delta);
+    lastIterations++;
   }
   epilogue();
+  lap(t, times.epilogue);
+  // 邻居与网格统计在 searchNeighbours / buildGrid 中更新
+  phaseTimings += times;
+  stepStats.step = static_cast<uint64_t>(stepCount);
+  stepStats.phases = times;
+  stepStats.iterations = lastIterations;
+  stepStats.warmStartPasses = warmStartPass ? 1 : 0;
+  stepStats.densityErrorMax = lastDensityError.max;
+  stepStats.densityErrorAvg = lastDensityError.avg;
+  stepCount++;
 }
-#pragma omp parallel for
-void Simulator::prologue() {
-  int gridNum = gridSize.x() * gridSize.y() * gridSize.z();
-  for (int i = 0; i <= gridNum; i++) {
-    gridToParticles[i].clear();
-  }
-  for (auto &p : particles) {
-    p.neighbour.clear(); // 清空邻居粒子
-    p.oldPos = p.pos;    // 备份粒子坐标
-  }
-  for (auto &p : particles) {
-    Eigen::Vector3f g = Eigen::Vector3f(0.0f, -9.8f, 0.0f); // 重力加速度
-    Eigen::Vector3f pos_i = p.pos;
-    Eigen::Vector3f vel_i = p.vel;
-    vel_i += g * dt;                // 更新速度
-    pos_i += vel_i * dt;            // 更新位置
-    p.pos = confineParticle(pos_i); // 检查粒子是否在边界内
-  }
-  // 初始化网格变量
-  //	std::unordered_map<Eigen::Vector3i, std::vector<Particle*>,
-  //glm_ivec3_hash> gridToParticles; 	int* gridToParticles = new int[gridSize.x()
-  //* gridSize.y() * gridSize.z()];
-  std::function vec2grid = [](Eigen::Vector3i pos, Eigen::Vector3i grid) {
-    return int(grid.y() * grid.z() * pos.x() + grid.z() * pos.y() + pos.z());
-  };
-  for (auto &p : particles) {
-    Eigen::Vector3i grid = getCell(p.pos); // 计算粒子所在的网格
-    gridToParticles[vec2grid(grid, gridSize)].push_back(
-        &p); // 将粒子添加到网格中
-  }
-  for (int i = 0; i < gridSize.x() * gridSize.y() * gridSize.z(); i++) {
-    auto &cellParticles = gridToParticles[i];
-    // 计算每个粒子的Morton码
-    std::sort(cellParticles.begin(), cellParticles.end(),
-              [this](Particle *a, Particle *b) {
-                return computeMortonCode(a->pos) < computeMortonCode(b->pos);
-              });
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::resetPhaseTimings() {
+  phaseTimings = PhaseTimings();
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::reorderParticles() {
+  const std::size_t n = particles.size();
+  mortonKeys.resize(n);
+  for (std::size_t i = 0; i < n; i++) {
+    mortonKeys[i] = computeMortonCode(particles.pos(i));
+  }
+  morton::radixSort(mortonKeys, reorderIndex, mortonKeyScratch,
+                    reorderIndexScratch);
+  particles.permute(reorderIndex, reorderScratch, idScratch);
+  neighboursValid = false; // 粒子下标改变，邻居表失效
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setSeed(uint32_t seed) {
+  this->seed = seed;
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setThreadNums(int threadNums) {
+  this->threadNums = threadNums;
+  pool = std::make_unique<ThreadPool>(threadNums);
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::parallelFor(
+    std::size_t n, std::size_t chunk, const ThreadPool::RangeFn &fn) {
+  if (pool) {
+    pool->parallelFor(0, n, chunk, fn);
+  } else {
+    fn(0, n, 0);
   }
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::prologue() {
+  const std::size_t n = particles.size();
+  pairCacheValid = false; // 提前结束迭代时缓存可能还标记为有效
+  parallelFor(n, grain, [this](std::size_t begin, std::size_t end, unsigned) {
+    const Eigen::Vector3f g = Eigen::Vector3f(0.0f, -9.8f, 0.0f); // 重力加速度
+    for (std::size_t i = begin; i < end; i++) {
+      particles.oldX[i] = particles.x[i]; // 备份粒子坐标
+      particles.oldY[i] = particles.y[i];
+      particles.oldZ[i] = particles.z[i];
+      Eigen::Vector3f pos_i = particles.pos(i);
+      Eigen::Vector3f vel_i = particles.vel(i);
+      vel_i += g * dt;                             // 更新速度
+      pos_i += vel_i * dt;                         // 更新位置
+      particles.setPos(i, confineParticle(pos_i, particles.id[i],
+                                          crng::kStreamPrologue)); // 检查粒子是否在边界内
+    }
+  });
+  // 邻居表仍然有效（最大位移不超过 skin / 2）时跳过网格构建与邻居搜索
+  if (!neighboursValid ||
+      maxDisplacementSq() > 0.25f * neighbourSkin * neighbourSkin) {
+    buildGrid();
+    searchNeighbours();
+  }
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setNeighbourSkin(float skin) {
+  // 27 个网格的搜索范围最多覆盖 cellSize
+  neighbourSkin = std::clamp(skin, 0.0f, cellSize - neighbourRadius);
+  neighbours.reserve(particles.size(), neighbourCapacity());
+  neighboursValid = false;
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setSymmetricPairs(bool enable) {
+  symmetricPairs = enable;
+  neighboursValid = false; // 需要重新划分邻居表并为网格着色
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::setPairCache(bool enable) {
+  pairCacheEnabled = enable;
+  pairCacheValid = false;
+  if (!enable) {
+    // 释放缓存占用的内存
+    AlignedVector<float>().swap(pairW);
+    AlignedVector<float>().swap(pairGX);
+    AlignedVector<float>().swap(pairGY);
+    AlignedVector<float>().swap(pairGZ);
+  }
+}
+template <class Kernel, class Boundary>
+sph::PairCache BasicSimulator<Kernel, Boundary>::pairCacheAt(uint32_t first) {
+  return {pairW.data() + first, pairGX.data() + first, pairGY.data() + first,
+          pairGZ.data() + first};
+}
+template <class Kernel, class Boundary>
+uint32_t BasicSimulator<Kernel, Boundary>::neighbourCapacity() const {
+  const float ratio = (neighbourRadius + neighbourSkin) / neighbourRadius;
+  return static_cast<uint32_t>(
+      std::ceil(static_cast<float>(maxNeighbour) * ratio * ratio * ratio));
+}
+template <class Kernel, class Boundary>
+template <class Fn>
+float BasicSimulator<Kernel, Boundary>::parallelMax(Fn &&value) {
+  threadMax.assign(pool ? pool->size() : 1, 0.0f);
+  parallelFor(particles.size(), grain,
+              [&](std::size_t begin, std::size_t end, unsigned thread) {
+                float localMax = 0.0f;
+                for (std::size_t i = begin; i < end; i++) {
+                  localMax = std::max(localMax, value(i));
+                }
+                threadMax[thread] = std::max(threadMax[thread], localMax);
+              });
+  return *std::max_element(threadMax.begin(), threadMax.end());
+}
+template <class Kernel, class Boundary>
+float BasicSimulator<Kernel, Boundary>::maxDisplacementSq() {
+  return parallelMax([this](std::size_t i) {
+    const float dx = particles.x[i] - buildX[i];
+    const float dy = particles.y[i] - buildY[i];
+    const float dz = particles.z[i] - buildZ[i];
+    return dx * dx + dy * dy + dz * dz;
+  });
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::searchNeighbours() {
   /*
-   * 遍历所有粒子，计算粒子所在的网格，并将粒子添加到网格中
    * 通过检查粒子所在网格与临近网格，可以以较高效率获取邻居粒子
-   *
-   * 优化：遍历所有网格，而不是遍历所有粒子，对于同一网格内的粒子进行并行处理，因为同一网格内的粒子互不影响
+   * 每个任务块把邻居下标写入自己的缓冲，再通过前缀和拼接成 CSR 邻居表
    */
-  for (auto &p : particles) {
-    Eigen::Vector3i grid = getCell(p.pos); // 计算粒子所在的网格
-    Eigen::Vector3f pos_i = p.pos;
-
-    float sqNeighbour = neighbourRadius * neighbourRadius;
-    std::vector<int> operatorNumber = {0, 1, -1};
-    for (int i : operatorNumber) {
-      for (int j : operatorNumber) {
-        for (int k : operatorNumber) {
-          Eigen::Vector3i grid_i =
-              grid + Eigen::Vector3i{i, j, k}; // 遍历周边网格
-          if (!isInRange(grid_i))
-            continue;
-          for (auto J : gridToParticles[vec2grid(grid_i, gridSize)]) {
-            if (J == &p)
-              continue;
-            Eigen::Vector3f pos_j = J->pos;
-            float r_sq = (pos_i - pos_j).squaredNorm();
-            if (r_sq < sqNeighbour &&
-                pos_i !=
-                    pos_j) { // 粒子在半径范围内，数量小于最大邻居数量，且距离小于邻居半径，则添加到邻居列表中
-              p.neighbour.push_back(J);
-            }
-            if (p.neighbour.size() >= maxNeighbour) {
-              break;
+  const std::size_t n = particles.size();
+  const std::size_t chunkNums = (n + grain - 1) / grain;
+  if (chunkNeighbours.size() < chunkNums) {
+    chunkNeighbours.resize(chunkNums);
+  }
+  chunkDropped.resize(chunkNums);
+  const float searchRadius = neighbourRadius + neighbourSkin;
+  const float sqNeighbour = searchRadius * searchRadius;
+  const std::size_t capacity = neighbourCapacity();
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    constexpr int operatorNumber[3] = {0, 1, -1};
+    auto &buffer = chunkNeighbours[begin / grain];
+    buffer.clear();
+    buffer.reserve(grain * capacity); // 只在第一次使用时分配
+    // 重排后相邻粒子大多在同一网格，缓存上一个网格的 27 个邻居槽，省去重复的哈希查找
+    Eigen::Vector3i cachedGrid = Eigen::Vector3i::Constant(INT_MIN);
+    std::array<uint32_t, 27> cachedSlots{};
+    uint32_t dropped = 0; // 超出上限没有写入邻居表的邻居数
+    for (std::size_t p = begin; p < end; p++) {
+      const std::size_t first = buffer.size();
+      Eigen::Vector3f pos_i = particles.pos(p);
+      Eigen::Vector3i grid = getCell(pos_i); // 计算粒子所在的网格
+      if (grid != cachedGrid) {
+        int slot = 0;
+        for (int i : operatorNumber) {
+          for (int j : operatorNumber) {
+            for (int k : operatorNumber) {
+              cachedSlots[slot++] = findCell(grid + Eigen::Vector3i{i, j, k});
             }
           }
         }
-        if (p.neighbour.size() >= maxNeighbour) {
+        cachedGrid = grid;
+      }
+      for (uint32_t c : cachedSlots) { // 遍历周边网格
+        if (c == CellHashTable::kNone)
+          continue;
+        for (uint32_t m = cells.cellStart[c]; m < cells.cellEnd[c]; m++) {
+          const uint32_t J = cellParticles[m];
+          if (J == p)
+            continue;
+          Eigen::Vector3f pos_j = particles.pos(J);
+          float r_sq = (pos_i - pos_j).squaredNorm();
+          if (r_sq >= sqNeighbour || pos_i == pos_j) {
+            continue;
+          }
+          // 粒子在半径范围内且数量小于最大邻居数量，则添加到邻居列表中
+          // 成对遍历时 j > i 的邻居超出上限也保留：j 的那一半不含 i，丢掉后这一对对两侧都不计入
+          if (buffer.size() - first < capacity || (symmetricPairs && J > p)) {
+            buffer.push_back(J);
+          } else {
+            dropped++;
+          }
+        }
+      }
+      if (symmetricPairs) {
+        // j > i 的邻居排在前面，成对遍历只访问这一段
+        const auto half =
+            std::partition(buffer.begin() + first, buffer.end(),
+                           [p](uint32_t J) { return J > p; });
+        neighbourHalf[p] =
+            static_cast<uint32_t>(half - (buffer.begin() + first));
+      }
+      neighbourCount[p] = static_cast<uint32_t>(buffer.size() - first);
+    }
+    chunkDropped[begin / grain] = dropped;
+  });
+  // 前缀和得到 offsets，容量在 init 中已预留
+  // 同时统计邻居数直方图与达到上限的粒子数
+  neighbours.offsets.resize(n + 1);
+  neighbours.offsets[0] = 0;
+  stepStats.neighbourHistogram.fill(0);
+  uint32_t truncated = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    neighbours.offsets[i + 1] = neighbours.offsets[i] + neighbourCount[i];
+    stepStats.neighbourHistogram[StepStats::neighbourBin(neighbourCount[i])]++;
+    truncated += neighbourCount[i] >= capacity ? 1u : 0u;
+  }
+  stepStats.truncatedParticles = truncated;
+  stepStats.droppedNeighbours =
+      std::accumulate(chunkDropped.begin(), chunkDropped.end(), 0u);
+  neighbours.indices.resize(neighbours.offsets[n]);
+  // 把各任务块的缓冲拷贝到 CSR 邻居表中
+  parallelFor(chunkNums, 1, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t c = begin; c < end; c++) {
+      const auto &buffer = chunkNeighbours[c];
+      std::memcpy(neighbours.indices.data() + neighbours.offsets[c * grain],
+                  buffer.data(), buffer.size() * sizeof(uint32_t));
+    }
+  });
+  if (neighbourSkin > 0.0f) {
+    // 记录构建时的位置，之后的步骤据此判断邻居表是否仍然有效
+    parallelFor(n, grain, [this](std::size_t begin, std::size_t end, unsigned) {
+      for (std::size_t i = begin; i < end; i++) {
+        buildX[i] = particles.x[i];
+        buildY[i] = particles.y[i];
+        buildZ[i] = particles.z[i];
+      }
+    });
+    neighboursValid = true;
+  }
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::buildGrid() {
+  const std::size_t n = particles.size();
+  const std::size_t chunkNums = (n + grain - 1) / grain;
+  chunkCellRuns.resize(chunkNums);
+  for (auto &runs : chunkCellRuns) {
+    runs.clear();
+  }
+  // 0. 并行计算每个粒子所在网格的键与哈希，同时记录任务块内网格相同的连续粒子段
+  parallelFor(n, grain, [this](std::size_t begin, std::size_t end, unsigned) {
+    auto &runs = chunkCellRuns[begin / grain];
+    for (std::size_t i = begin; i < end; i++) {
+      const Eigen::Vector3i grid = getCell(particles.pos(i)); // 计算粒子所在的网格
+      particleCellKey[i] = cellhash::packCell(grid.x(), grid.y(), grid.z());
+      particleCellHash[i] = cellhash::hashCell(grid.x(), grid.y(), grid.z());
+      if (i == begin || particleCellKey[i] != particleCellKey[i - 1]) {
+        runs.push_back(static_cast<uint32_t>(i)); // 新的一段
+      }
+    }
+  });
+  // 1. 插入哈希表，只有这一步串行；重排后相邻粒子大多在同一网格，每段只插入一次
+  for (bool built = false; !built;) {
+    cells.clear(); // 只重置上一帧的非空网格
+    built = true;
+    for (std::size_t k = 0; k < chunkNums && built; k++) {
+      for (uint32_t i : chunkCellRuns[k]) {
+        const uint32_t c =
+            cells.insert(particleCellKey[i], particleCellHash[i]);
+        if (c == CellHashTable::kNone) {
+          // 非空网格超过容量，扩容后重新插入
+          cells.reserve(cells.capacity());
+          built = false;
           break;
         }
+        particleCell[i] = c;
       }
-      if (p.neighbour.size() >= maxNeighbour) {
-        break;
+    }
+  }
+  // 对任务块内的每一段调用 run(c, first, last)
+  auto forEachRun = [this](std::size_t begin, std::size_t end, auto &&run) {
+    const auto &runs = chunkCellRuns[begin / grain];
+    for (std::size_t r = 0; r < runs.size(); r++) {
+      const uint32_t first = runs[r];
+      const uint32_t last =
+          r + 1 < runs.size() ? runs[r + 1] : static_cast<uint32_t>(end);
+      run(particleCell[first], first, last);
+    }
+  };
+  // 2. 并行统计直方图，cellEnd 暂时用作计数，每段只做一次原子加法
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    forEachRun(begin, end, [this](uint32_t c, uint32_t first, uint32_t last) {
+      std::fill(particleCell.begin() + first + 1, particleCell.begin() + last,
+                c);
+      std::atomic_ref<uint32_t>(cells.cellEnd[c])
+          .fetch_add(last - first, std::memory_order_relaxed);
+    });
+  });
+  // 3. 对非空网格做排他前缀和，cellEnd 之后作为散射游标
+  uint32_t running = 0, maxOccupancy = 0;
+  for (uint32_t c : cells.occupied) {
+    const uint32_t count = cells.cellEnd[c];
+    cells.cellStart[c] = cells.cellEnd[c] = running;
+    running += count;
+    maxOccupancy = std::max(maxOccupancy, count);
+  }
+  stepStats.occupiedCells = static_cast<uint32_t>(cells.size());
+  stepStats.maxCellOccupancy = maxOccupancy;
+  // 4. 并行散射，每段原子地占用网格内一段连续位置，结束后 cellEnd[c] 恰好为网格的结束位置
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    forEachRun(begin, end, [this](uint32_t c, uint32_t first, uint32_t last) {
+      const uint32_t slot = std::atomic_ref<uint32_t>(cells.cellEnd[c])
+                                .fetch_add(last - first,
+                                           std::memory_order_relaxed);
+      std::iota(cellParticles.begin() + slot,
+                cellParticles.begin() + slot + (last - first), first);
+    });
+  });
+  // 5. 段的先后取决于调度，网格内按粒子下标排序，结果与串行散射相同，与线程数无关
+  parallelFor(cells.size(), 64,
+              [this](std::size_t begin, std::size_t end, unsigned) {
+                for (std::size_t k = begin; k < end; k++) {
+                  const uint32_t c = cells.occupied[k];
+                  const auto first = cellParticles.begin() + cells.cellStart[c];
+                  const auto last = cellParticles.begin() + cells.cellEnd[c];
+                  if (!std::is_sorted(first, last)) {
+                    std::sort(first, last);
+                  }
+                }
+              });
+  if (symmetricPairs) {
+    buildCellColours();
+  }
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::buildCellColours() {
+  // 颜色 = 网格坐标 mod 3，键中的坐标带有相同的偏移，不影响同色网格的间距
+  auto colour = [](uint64_t key) {
+    const uint64_t x = key >> (2 * cellhash::kBitsPerAxis);
+    const uint64_t y = (key >> cellhash::kBitsPerAxis) & cellhash::kAxisMask;
+    const uint64_t z = key & cellhash::kAxisMask;
+    return static_cast<uint32_t>(x % 3 * 9 + y % 3 * 3 + z % 3);
+  };
+  // 计数排序，同一颜色内保持插入顺序
+  colourStart.fill(0);
+  for (uint32_t c : cells.occupied) {
+    colourStart[colour(cells.keys[c]) + 1]++;
+  }
+  for (int k = 0; k < kColours; k++) {
+    colourStart[k + 1] += colourStart[k];
+  }
+  std::array<uint32_t, kColours> cursor;
+  std::copy_n(colourStart.begin(), kColours, cursor.begin());
+  colourCells.resize(cells.size());
+  for (uint32_t c : cells.occupied) {
+    colourCells[cursor[colour(cells.keys[c])]++] = c;
+  }
+}
+template <class Kernel, class Boundary>
+template <class Fn>
+void BasicSimulator<Kernel, Boundary>::forEachPair(float cutoff2, Fn &&pair) {
+  const uint32_t *nbr = neighbours.indices.data();
+  const float *x = particles.x.data();
+  const float *y = particles.y.data();
+  const float *z = particles.z.data();
+  // 同一颜色的网格邻域互不相交，颜色之间串行
+  for (int colour = 0; colour < kColours; colour++) {
+    const uint32_t first = colourStart[colour];
+    const uint32_t count = colourStart[colour + 1] - first;
+    if (count == 0) {
+      continue;
+    }
+    parallelFor(count, 64, [&](std::size_t begin, std::size_t end, unsigned) {
+      for (std::size_t k = begin; k < end; k++) {
+        const uint32_t c = colourCells[first + k];
+        for (uint32_t m = cells.cellStart[c]; m < cells.cellEnd[c]; m++) {
+          const uint32_t i = cellParticles[m];
+          const float xi = x[i], yi = y[i], zi = z[i];
+          const uint32_t *half = nbr + neighbours.begin(i);
+          for (uint32_t e = 0; e < neighbourHalf[i]; e++) {
+            const uint32_t j = half[e];
+            const float sx = xi - x[j], sy = yi - y[j], sz = zi - z[j];
+            const float r2 = sx * sx + sy * sy + sz * sz;
+            if (r2 <= 0.0f || r2 >= cutoff2) {
+              continue;
+            }
+            pair(i, j, sx, sy, sz, r2);
+          }
+        }
       }
+    });
+  }
+}
+template <class Kernel, class Boundary>
+typename BasicSimulator<Kernel, Boundary>::DensityError
+BasicSimulator<Kernel, Boundary>::computeLambdaPairs() {
+  const sph::KernelConstants k = kernelConstants();
+  const std::size_t n = particles.size();
+  // 密度直接在 particles.density 中累加，Σ∇W 借用 delta 缓冲
+  float *density = particles.density.data();
+  float *gradX = deltaX.data(), *gradY = deltaY.data(), *gradZ = deltaZ.data();
+  float *gradSq = pairGradSq.data();
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      density[i] = gradX[i] = gradY[i] = gradZ[i] = gradSq[i] = 0.0f;
     }
+  });
+  forEachPair(k.cutoff2, [&](uint32_t i, uint32_t j, float sx, float sy,
+                             float sz, float r2) {
+    const float r = std::sqrt(r2);
+    const float w = Kernel::w(r, r2);
+    const float g = Kernel::gradFactor(r);
+    const float gx = sx * g, gy = sy * g, gz = sz * g;
+    const float sq = gx * gx + gy * gy + gz * gz;
+    density[i] += w;
+    density[j] += w;
+    gradX[i] += gx;
+    gradY[i] += gy;
+    gradZ[i] += gz;
+    gradX[j] -= gx;
+    gradY[j] -= gy;
+    gradZ[j] -= gz;
+    gradSq[i] += sq;
+    gradSq[j] += sq;
+  });
+  // 由累加结果求 lambda，与 computeLambda 相同
+  const unsigned threads = pool ? pool->size() : 1;
+  threadMax.assign(threads, 0.0f);
+  threadSum.assign(threads, 0.0);
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end,
+                            unsigned thread) {
+    float errorMax = 0.0f;
+    double errorSum = 0.0;
+    for (std::size_t i = begin; i < end; i++) {
+      density[i] = (mass * density[i] / rho) - 1.0f;
+      const float sumSqrGrad = gradSq[i] + gradX[i] * gradX[i] +
+                               gradY[i] * gradY[i] + gradZ[i] * gradZ[i];
+      particles.lambda[i] = -density[i] / (sumSqrGrad + lambdaEpsilon);
+      const float error = std::max(density[i], 0.0f);
+      errorMax = std::max(errorMax, error);
+      errorSum += error;
+    }
+    threadMax[thread] = std::max(threadMax[thread], errorMax);
+    threadSum[thread] += errorSum;
+  });
+  DensityError error;
+  error.max = *std::max_element(threadMax.begin(), threadMax.end());
+  double sum = 0.0;
+  for (double s : threadSum) {
+    sum += s;
   }
+  error.avg = n > 0 ? static_cast<float>(sum / static_cast<double>(n)) : 0.0f;
+  return error;
 }
-#pragma omp parallel for
-void Simulator::update() { // 在这里不写 while-loop，因为渲染不在这里
-  float ref_poly6 = poly6Value(0.33f, h);
-  float inf_ref_poly6 = 1.0f / ref_poly6;
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::applyDeltaPairs() {
+  const sph::KernelConstants k = kernelConstants();
+  const std::size_t n = particles.size();
+  const float *lambda = particles.lambda.data();
+  float *dx = deltaX.data(), *dy = deltaY.data(), *dz = deltaZ.data();
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      dx[i] = dy[i] = dz[i] = 0.0f;
+    }
+  });
+  // 系数 (λ_i + λ_j + scorr) 对称，梯度反对称
+  forEachPair(k.cutoff2, [&](uint32_t i, uint32_t j, float sx, float sy,
+                             float sz, float r2) {
+    const float r = std::sqrt(r2);
+    float t = Kernel::w(r, r2) * k.invRefPoly6;
+    t = t * t;
+    const float coef =
+        (lambda[i] + lambda[j] + k.scorrK * t * t) * Kernel::gradFactor(r);
+    const float px = coef * sx, py = coef * sy, pz = coef * sz;
+    dx[i] += px;
+    dy[i] += py;
+    dz[i] += pz;
+    dx[j] -= px;
+    dy[j] -= py;
+    dz[j] -= pz;
+  });
+  const float invRho = 1.0f / rho;
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      particles.x[i] += dx[i] * invRho;
+      particles.y[i] += dy[i] * invRho;
+      particles.z[i] += dz[i] * invRho;
+    }
+  });
+}
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::update() { // 在这里不写 while-loop，因为渲染不在这里
   /*
    * 借鉴SPH和PBF论文，考虑单个粒子的受力情况
    * 1.粒子间的作用力
@@ -205,96 +945,203 @@ void Simulator::update() { // 在这里不写 while-loop，因为渲染不在这
    * 3.不可压缩的粒子的实现
    * 4.粒子粘滞系数带来的受力
    */
+  computeLambda();
+  applyDelta();
+}
+template <class Kernel, class Boundary>
+typename BasicSimulator<Kernel, Boundary>::DensityError
+BasicSimulator<Kernel, Boundary>::computeLambda() {
+  if (symmetricPairs) {
+    return computeLambdaPairs();
+  }
+  // 批量核函数的常量，与 kernelValue / kernelGradient 的结果一致
+  const sph::KernelConstants k = kernelConstants();
+  const sph::KernelDispatch &kern = *kernels;
   // 计算拉格朗日乘数
-  for (auto &p : particles) {
-    Eigen::Vector3f pos_i = p.pos;
-    Eigen::Vector3f grad_i = Eigen::Vector3f::Zero();
-    float densityConstraint = 0.0f; // 密度约束
-    float sumSqrGrad = 0.0f;        // 梯度平方和
-    int size = std::min(static_cast<int>(p.neighbour.size()), maxNeighbour);
-    for (int j = 0; j < size; j++) {
-      auto q = p.neighbour[j];
-      if (q == &p)
-        continue;                         // 自身不计算
-      Eigen::Vector3f s = pos_i - q->pos; // 计算粒子间的距离
-      float r = s.norm();
-      float poly6 = poly6Value(r, h); // 计算核函数
-      Eigen::Vector3f grad = spikyGradient(s, r, h);
-      grad_i += grad;               // 累加梯度
-      densityConstraint += poly6;   // 累加密度约束
-      sumSqrGrad += grad.dot(grad); // 累加梯度平方和
-    }
-    p.density = ((mass * densityConstraint / rho) - 1.0f); // 更新粒子密度
-    sumSqrGrad += grad_i.dot(grad_i);
-    p.lambda =
-        (-1.0f * p.density) / (sumSqrGrad + lambdaEpsilon); // 计算拉格朗日乘子
-  }
-  // 计算粒子位置增量
-  for (auto &p : particles) {
-    Eigen::Vector3f posDelta = Eigen::Vector3f::Zero();
-    Eigen::Vector3f pos_i = p.pos;
-    float lambda_i = p.lambda;
-    Eigen::Vector3f grad_i = Eigen::Vector3f::Zero();
-    int size = std::min(static_cast<int>(p.neighbour.size()), maxNeighbour);
-    for (int j = 0; j < size; j++) {
-      auto q = p.neighbour[j];
-      if (q == &p)
-        continue; // 自身不计算
-      float lambda_j = q->lambda;
-      Eigen::Vector3f s = pos_i - q->pos;
-      float r = s.norm();
-      // 粒子压力矫正因子
-      float poly6 = poly6Value(r, h);
-      float scorr_ij = poly6 * inf_ref_poly6;
-      scorr_ij = scorr_ij * scorr_ij;
-      scorr_ij = scorr_ij * scorr_ij * (-0.001f);
-      posDelta += (lambda_i + lambda_j + scorr_ij) *
-                  spikyGradient(s, r, h); // 计算位置增量
-      // ** 在更新位置的时候，邻居粒子位置会变化，所以预存的梯度是错误的 **
+  const std::size_t n = particles.size();
+  const uint32_t *nbr = neighbours.indices.data();
+  const sph::ParticleArrays arrays{particles.x.data(), particles.y.data(),
+                                   particles.z.data(), particles.lambda.data()};
+  const unsigned threads = pool ? pool->size() : 1;
+  threadMax.assign(threads, 0.0f);
+  threadSum.assign(threads, 0.0);
+  // 邻居表的总长度在重建后才确定，这里按需扩容（只增不减）
+  const bool cache = pairCacheEnabled;
+  if (cache && pairW.size() < neighbours.indices.size()) {
+    const std::size_t size = neighbours.indices.size();
+    pairW.resize(size);
+    pairGX.resize(size);
+    pairGY.resize(size);
+    pairGZ.resize(size);
+  }
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end,
+                            unsigned thread) {
+    float errorMax = 0.0f;
+    double errorSum = 0.0;
+    for (std::size_t i = begin; i < end; i++) {
+      const uint32_t first = neighbours.begin(i);
+      const uint32_t count = neighbours.end(i) - first;
+      const sph::LambdaSums sums =
+          cache ? kern.lambdaCached(arrays, nbr + first, count, arrays.x[i],
+                                    arrays.y[i], arrays.z[i], k,
+                                    pairCacheAt(first))
+                : kern.lambda(arrays, nbr + first, count, arrays.x[i],
+                              arrays.y[i], arrays.z[i], k);
+      particles.density[i] =
+          ((mass * sums.density / rho) - 1.0f); // 更新粒子密度
+      const float sumSqrGrad = sums.sumSqrGrad + sums.gradX * sums.gradX +
+                               sums.gradY * sums.gradY +
+                               sums.gradZ * sums.gradZ;
+      particles.lambda[i] = (-1.0f * particles.density[i]) /
+                            (sumSqrGrad + lambdaEpsilon); // 计算拉格朗日乘子
+      // 只统计压缩，自由表面附近密度不足的粒子不计入误差
+      const float error = std::max(particles.density[i], 0.0f);
+      errorMax = std::max(errorMax, error);
+      errorSum += error;
     }
-    posDelta /= rho;   // 平均位置增量, 除以水的密度
-    p.pos += posDelta; // 更新粒子位置
+    threadMax[thread] = std::max(threadMax[thread], errorMax);
+    threadSum[thread] += errorSum;
+  });
+  pairCacheValid = cache;
+  DensityError error;
+  error.max = *std::max_element(threadMax.begin(), threadMax.end());
+  double sum = 0.0;
+  for (double s : threadSum) {
+    sum += s;
   }
+  error.avg = n > 0 ? static_cast<float>(sum / static_cast<double>(n)) : 0.0f;
+  return error;
 }
-void Simulator::epilogue() {
-  for (auto &p : particles) {
-    auto pos = p.pos;
-    p.pos = confineParticle(pos);
-  }
-  for (auto &p : particles) {
-    p.vel = (p.pos - p.oldPos) / dt;
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::applyDelta() {
+  if (symmetricPairs) {
+    applyDeltaPairs();
+    return;
   }
+  const sph::KernelConstants k = kernelConstants();
+  const sph::KernelDispatch &kern = *kernels;
+  const std::size_t n = particles.size();
+  const uint32_t *nbr = neighbours.indices.data();
+  const sph::ParticleArrays arrays{particles.x.data(), particles.y.data(),
+                                   particles.z.data(), particles.lambda.data()};
+  // 计算粒子位置增量（Jacobi：先全部写入 delta，再统一更新位置）
+  // 含粒子压力矫正因子 scorr = -corrK * (W / W(Δq))^4
+  const float invRho = 1.0f / rho;
+  const bool cached = pairCacheValid;
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      const uint32_t first = neighbours.begin(i);
+      const uint32_t count = neighbours.end(i) - first;
+      const sph::DeltaSums sums =
+          cached ? kern.deltaCached(arrays.lambda, nbr + first, count,
+                                    pairCacheAt(first), arrays.lambda[i], k)
+                 : kern.delta(arrays, nbr + first, count, arrays.x[i],
+                              arrays.y[i], arrays.z[i], arrays.lambda[i], k);
+      // 平均位置增量, 除以水的密度
+      deltaX[i] = sums.x * invRho;
+      deltaY[i] = sums.y * invRho;
+      deltaZ[i] = sums.z * invRho;
+    }
+  });
+  pairCacheValid = false; // 位置改变，缓存失效
+  // 所有增量计算完毕后再更新粒子位置
+  parallelFor(n, grain, [this](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      particles.x[i] += deltaX[i];
+      particles.y[i] += deltaY[i];
+      particles.z[i] += deltaZ[i];
+    }
+  });
 }
-
-const std::vector<Eigen::Vector3f> &Simulator::getParticlePos() {
-  particlePos.clear();
-  for (auto &p : particles) {
-    particlePos.push_back(p.pos);
+template <class Kernel, class Boundary>
+void BasicSimulator<Kernel, Boundary>::epilogue() {
+  const std::size_t n = particles.size();
+  const bool fused = xsphViscosity > 0.0f || vorticityEpsilon > 0.0f;
+  parallelFor(n, grain, [this, fused](std::size_t begin, std::size_t end,
+                                      unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      particles.setPos(i, confineParticle(particles.pos(i), particles.id[i],
+                                          crng::kStreamEpilogue));
+      if (!fused) {
+        particles.setVel(i, (particles.pos(i) - particles.oldPos(i)) / dt);
+      }
+    }
+  });
+  if (!fused) {
+    return;
   }
-  return particlePos;
+  /*
+   * 速度更新、XSPH 与涡量约束在同一次邻居遍历中完成：
+   * 邻居的速度由最终位置与 oldPos 现算，只读位置、写速度，
+   * 上一步的 |ω| 只读、本步的写入 vorticityNext，结果与线程数无关
+   */
+  const float cutoff2 = kernelConstants().cutoff2;
+  const float invDt = 1.0f / dt;
+  const float volume = mass / rho;
+  const uint32_t *nbr = neighbours.indices.data();
+  parallelFor(n, grain, [&](std::size_t begin, std::size_t end, unsigned) {
+    for (std::size_t i = begin; i < end; i++) {
+      const Eigen::Vector3f pos_i = particles.pos(i);
+      const Eigen::Vector3f vel_i = (pos_i - particles.oldPos(i)) * invDt;
+      const float vorticity_i = particles.vorticity[i];
+      Eigen::Vector3f viscosity = Eigen::Vector3f::Zero();
+      Eigen::Vector3f omega = Eigen::Vector3f::Zero(); // ω_i
+      Eigen::Vector3f eta = Eigen::Vector3f::Zero();   // ∇|ω|
+      for (uint32_t m = neighbours.begin(i); m < neighbours.end(i); m++) {
+        const uint32_t j = nbr[m];
+        const Eigen::Vector3f pos_j = particles.pos(j);
+        const Eigen::Vector3f s = pos_i - pos_j;
+        const float r2 = s.squaredNorm();
+        if (r2 <= 0.0f || r2 >= cutoff2) {
+          continue;
+        }
+        const float r = std::sqrt(r2);
+        const Eigen::Vector3f v_ij =
+            (pos_j - particles.oldPos(j)) * invDt - vel_i;
+        const Eigen::Vector3f grad = Kernel::gradFactor(r) * s; // ∇_i W_ij = -∇_j W_ij
+        viscosity += Kernel::w(r, r2) * v_ij;
+        omega += grad.cross(v_ij);
+        eta += (particles.vorticity[j] - vorticity_i) * grad;
+      }
+      omega *= volume;
+      Eigen::Vector3f vel = vel_i + xsphViscosity * volume * viscosity;
+      const float etaNorm = eta.norm();
+      if (vorticityEpsilon > 0.0f && etaNorm > epsilon) {
+        vel += (dt * vorticityEpsilon / etaNorm) * eta.cross(omega);
+      }
+      particles.setVel(i, vel);
+      vorticityNext[i] = omega.norm();
+    }
+  });
+  particles.vorticity.swap(vorticityNext);
 }
 
-Eigen::Vector3f Simulator::spikyGradient(Eigen::Vector3f s, float r, float h) {
-  if (0 >= r || r >= h)
-    return Eigen::Vector3f::Zero();
-  const float spikyGradientFactor = -45.0f / PI;
-  const float x = (h - r) / (h * h * h);
-  const float g_factor = spikyGradientFactor * x * x;
-  return s * g_factor / r;
+template <class Kernel, class Boundary>
+ParticlePosView BasicSimulator<Kernel, Boundary>::getParticlePos() const {
+  return {particles.x, particles.y, particles.z};
 }
 
-Eigen::Vector3f Simulator::getBoundingBox() { return boundary; }
-
-unsigned int Simulator::computeMortonCode(Eigen::Vector3f pos) {
-  // 将世界坐标转换为网格内的相对坐标
-  Eigen::Vector3i gridPos = getCell(pos);
+template <class Kernel, class Boundary>
+Eigen::Vector3f BasicSimulator<Kernel, Boundary>::getBoundingBox() {
+  return boundary;
+}
 
-  // 交错位编码（简化示例）
-  unsigned int result = 0;
-  for (int i = 0; i < 10; i++) { // 假设网格大小在1024x1024x1024内
-    result |= ((gridPos.x() >> i) & 1) << (i * 3) |
-              ((gridPos.y() >> i) & 1) << (i * 3 + 1) |
-              ((gridPos.z() >> i) & 1) << (i * 3 + 2);
-  }
-  return result;
+template <class Kernel, class Boundary>
+uint64_t BasicSimulator<Kernel, Boundary>::computeMortonCode(
+    const Eigen::Vector3f &pos) const {
+  // 将世界坐标按边界量化到每轴 21 位，比网格更细，网格内部也保持 Z 序
+  const Eigen::Vector3f scale =
+      Eigen::Vector3f::Constant(static_cast<float>(morton::kAxisMax))
+          .cwiseQuotient(boundary);
+  const Eigen::Vector3f q = pos.cwiseProduct(scale).cwiseMax(0.0f).cwiseMin(
+      static_cast<float>(morton::kAxisMax));
+  return morton::encode3(static_cast<uint32_t>(q.x()),
+                         static_cast<uint32_t>(q.y()),
+                         static_cast<uint32_t>(q.z()));
 }
+
+// 显式实例化，对应 FluidSimulator.h 中的几种配置
+template class BasicSimulator<sph::Poly6Spiky<>, sph::ClampBoundary>;
+template class BasicSimulator<sph::CubicSpline<>, sph::ClampBoundary>;
+template class BasicSimulator<sph::WendlandC2<>, sph::ClampBoundary>;
+template class BasicSimulator<sph::Poly6Spiky<>, sph::MarginBoundary>;
@@ -1,27 +1,83 @@
 ﻿#ifndef FLUID_SIMULATOR_H
 #define FLUID_SIMULATOR_H
 
+#include <array>
+#include <memory>
+#include <string>
+
+#include "BoundaryPolicy.h"
+#include "CellHashTable.h"
+#include "KernelPolicy.h"
 #include "Particle.h"
+#include "SPHKernelsSIMD.h"
+#include "Rendering/Assets/fluid/StepStats.h"
+#include "Utils/ThreadPool.h"
+
+class FrameExporter;
 
-class Simulator{ // 使用拉格朗日法求粒子在每一帧的更新
+/*
+ * Kernel：核函数策略（sph::Poly6Spiky / CubicSpline / WendlandC2，见 KernelPolicy.h），核半径与系数在编译期确定
+ * Boundary：边界处理策略（sph::ClampBoundary / MarginBoundary，见 BoundaryPolicy.h）
+ * 可用的组合在 FluidSimulator.cpp 末尾显式实例化，默认配置为 Simulator
+ */
+template<class Kernel, class Boundary>
+class BasicSimulator{ // 使用拉格朗日法求粒子在每一帧的更新
 public:
-    Simulator() = default;
-	explicit Simulator(int particleNums);
-    ~Simulator() = default;
+    BasicSimulator() = default;
+	explicit BasicSimulator(int particleNums);
+    ~BasicSimulator() = default;
+	BasicSimulator(BasicSimulator&&) noexcept = default;
+	BasicSimulator& operator=(BasicSimulator&&) noexcept = default;
 
     void init(int particleNums);
-	float poly6Value(float, float h); // 计算核函数
-	Eigen::Vector3f spikyGradient(Eigen::Vector3f, float r, float h);
+	void init(const std::vector<Eigen::Vector3f> &positions); // 从给定的初始位置初始化（如 Scenario.h 生成的场景），速度为 0
+	void setThreadNums(int threadNums); // 设置求解器线程数，0 表示使用硬件线程数，1 为串行
+	void setSimdLevel(sph::SimdLevel maxLevel); // 限制批量核函数使用的最高指令集，默认自动检测
+	void setNeighbourSkin(float skin); // 邻居表复用的额外搜索半径，0 表示每步重建邻居表
+	void setSymmetricPairs(bool enable); // lambda / 位置增量按邻居对 (i < j) 遍历，每对只计算一次核函数，默认关闭
+	void setPairCache(bool enable); // lambda 时缓存每个邻居的 W 与 ∇W，同一次迭代的位置增量直接读取，默认关闭
+	void setSeed(uint32_t seed); // 设置随机数种子，在 init 之前调用才会影响初始位置
+	float kernelValue(float r) const; // 计算核函数 W(r)
+	Eigen::Vector3f kernelGradient(const Eigen::Vector3f &s, float r) const; // 计算核函数梯度 ∇W(s)
 
-	void runPBF(); // 执行PBF算法
+	void runPBF(); // 执行PBF算法；开启自适应步长时推进 frameTime，内部可能执行多个子步
+	// 自适应步长：每个子步按 CFL 条件 dt = cfl * h / vmax 选取，子步数不超过 maxSubsteps，dt 不超过 frameTime
+	void setAdaptiveTimestep(bool enable, float frameTime = 0.05f, float cfl = 0.4f, int maxSubsteps = 16);
+	int getLastSubsteps() const { return lastSubsteps; } // 上一次 runPBF 执行的子步数
+	float getTimestep() const { return dt; } // 上一个子步使用的 dt
+	// 密度误差：每个粒子取压缩量 max(ρ/ρ0 - 1, 0)，统计最大值与平均值
+	struct DensityError {
+		float max = 0.0f;
+		float avg = 0.0f;
+	};
+	// 平均密度误差不超过 tolerance 时提前结束迭代，pbfNumIters 为迭代次数上限；0 表示固定迭代 pbfNumIters 次
+	void setDensityTolerance(float tolerance);
+	void setWarmStart(bool enable); // 每步先用上一步的 lambda 做一次位置修正（init 之后的第一步跳过），计入 StepStats::warmStartPasses
+	// XSPH 粘性与涡量约束，在 epilogue 更新速度时同一次邻居遍历中完成；系数为 0 表示关闭（默认）
+	void setXSPHViscosity(float c);
+	void setVorticityConfinement(float eps);
+	int getLastIterations() const { return lastIterations; } // 上一个子步实际执行的迭代次数，不含热启动的那次修正
+	DensityError getLastDensityError() const { return lastDensityError; } // 上一个子步最后一次 lambda 计算时的密度误差
+	// 各阶段累计耗时（秒，见 StepStats.h），每个子步累加一次，init 与 resetPhaseTimings 时清零
+	const PhaseTimings &getPhaseTimings() const { return phaseTimings; }
+	void resetPhaseTimings();
+	const StepStats &getStepStats() const { return stepStats; } // 上一个子步的统计
 	void prologue(); // 初始化粒子状态(拉格朗日法)
-    void update(); // 当更新帧时，调用该函数更新流体状态(拉格朗日法)
-	void epilogue();
+    void update(); // 当更新帧时，调用该函数更新流体状态(拉格朗日法)，即 computeLambda() + applyDelta()
+	DensityError computeLambda(); // 计算密度与拉格朗日乘子，同时归约出密度误差
+	void applyDelta(); // 由当前的 lambda 计算并应用位置增量
+	void epilogue(); // 限制边界并由位移更新速度，开启 XSPH / 涡量约束时同时遍历邻居修正速度
+	void reorderParticles(); // 按 Morton 码（Z 序）重排粒子内存，使空间上相邻的粒子在内存中也相邻
+	// 快照（格式见 Checkpoint.h）：保存 / 恢复全部粒子属性、步数、随机数种子、PBF 参数、模拟区域与网格参数，失败时返回 false
+	bool save(const std::string &path) const;
+	bool load(const std::string &path);
+	// 帧导出（见 FrameExporter.h）：每次 runPBF 结束后按导出器的间隔拷贝一帧交给后台线程，nullptr 表示关闭；不持有导出器
+	void setFrameExporter(FrameExporter *exporter) { frameExporter = exporter; }
 
-	const std::vector<Particle>& getParticles(); // 获得粒子对象
+	ParticleView getParticles() const; // 获得粒子属性的只读视图（不拷贝）
 //	const Particle* getParticles(); // 获得粒子对象
 //	const int getParticleNums();
-	const std::vector<Eigen::Vector3f>& getParticlePos();
+	ParticlePosView getParticlePos() const; // 获得粒子位置的只读视图（不拷贝）
 
 	Eigen::Vector3f getBoundingBox();
 
@@ -38,50 +94,165 @@ private:
 	// ----------- 网格坐标计算 ----------
 	float cellSize = 2.51; // 单位：世界坐标单位
 	float cellRecpr = 1.0 / cellSize; // 单位：世界坐标单位^-1
-	Eigen::Vector3i gridSize = Eigen::Vector3i(roundUp(boundary.x(), 1), roundUp(boundary.y(), 1), roundUp(boundary.z(), 1)); // 网格大小，默认64*64*64
-//	std::vector<std::vector<Particle*>> gridToParticles((gridSize.x() * gridSize.y() * gridSize.z()));
-	std::vector<Particle*> gridToParticles[2000000];
 	/*
-	 * @brief: 确保网格数量能够覆盖整个场景
-	 * @param arg1: 需要向上取整的数
-	 * @param arg2: 需要向上取整的倍数
-	 * @return: 向上取整后的结果（整数加一，防止丢失信息，** 不用ceil的原因 **）
-	 * 对于 dx=64, dy=64, dz=64, boundary=64*64*64, cellSize=2.51, cellRecpr=1.0/2.51
-	 * 64/2.51=26.4，向上取整为27，所以最终网格大小为27*27*27
+	 * 网格索引（哈希表 + 计数排序）：
+	 *  0. 并行计算每个粒子所在网格的键与哈希，把每个任务块切成网格相同的连续粒子段
+	 *  1. 把每段的网格插入哈希表（串行，重排后段数远少于粒子数）
+	 *  2. 并行统计每个网格的粒子数（直方图），每段一次原子加法
+	 *  3. 对非空网格做前缀和，得到每个网格在 cellParticles 中的起点
+	 *  4. 并行把粒子下标散射到 cellParticles 中，再在网格内按下标排序，结果与线程数无关
+	 * 槽 s 内的粒子为 cellParticles[cellStart[s], cellEnd[s])
+	 * 只存放非空网格，内存与构建代价为 O(粒子数 + 非空网格数)，与 boundary 的大小无关
 	 */
-	int roundUp(float, float);
+	CellHashTable cells;
+	std::vector<uint32_t> cellParticles; // 按网格排好序的粒子下标
+	std::vector<uint32_t> particleCell;  // 每个粒子所在网格的槽
+	std::vector<uint64_t> particleCellKey; // 每个粒子所在网格的键
+	std::vector<uint32_t> particleCellHash; // 每个粒子所在网格的哈希
+	std::vector<std::vector<uint32_t>> chunkCellRuns; // 每个任务块内网格相同的连续粒子段的起点，跨帧复用容量
+	void buildGrid();
+	void allocateBuffers(std::size_t particleNums); // 按粒子数分配网格、邻居表与增量等缓冲
+	uint32_t findCell(const Eigen::Vector3i &cell) const; // 网格坐标 -> 槽，空网格返回 CellHashTable::kNone
 
 	// ----------- 网格参数 ----------
 	int maxNeighbour = 40;
 
 	// ----------- 粒子参数 ----------
-    float dt = 0.05f; // 更新时间间隔
+    float dt = 0.05f; // 更新时间间隔，开启自适应步长时每个子步重新计算
+
+	// ----------- 自适应步长 ----------
+	bool adaptiveDt = false;
+	float frameTime = 0.05f; // 每次 runPBF 推进的时间
+	float cflNumber = 0.4f; // 每个子步粒子最多移动 cflNumber * h
+	int maxSubsteps = 16; // 每帧子步数上限，达到上限时按 frameTime / maxSubsteps 推进
+	int lastSubsteps = 1;
+	float maxSpeed(); // 粒子最大速率（并行归约）
+	float cflTimestep(); // 由 CFL 条件与重力加速度给出的子步长
+	void step(); // 以当前 dt 执行一个完整的 PBF 子步
 	float particleRadius = 1.1f, particleRadiusInWorld = particleRadius / screenToWorldRatio; // 粒子半径，默认3.0，单位：世界坐标单位
-    std::vector<Particle> particles; // 粒子对象
+    ParticleStore particles; // 粒子属性（SoA）
+	NeighbourList neighbours; // 邻居表（CSR），每步在 prologue 中重建
 //	Particle particles[2000000];
 //	int particleNums;
-	std::vector<Eigen::Vector3f> particlePos;
     Eigen::Vector3f gravity;
 
 	// ----------- 粒子更新 ----------
-	Eigen::Vector3f confineParticle(Eigen::Vector3f pos); // 限制粒子在边界内，对超出边界的粒子的位置进行修正
+	// 限制粒子在边界内，对超出边界的粒子的位置进行修正；抖动量由 (粒子编号, 步数, 用途, 种子) 决定
+	Eigen::Vector3f confineParticle(Eigen::Vector3f pos, uint32_t id, uint32_t stream);
+	uint32_t seed = 0x5eedu; // 随机数种子，相同种子的两次运行结果一致
 	Eigen::Vector3i getCell(Eigen::Vector3f pos);
 
+	// ----------- 并行 ----------
+	/*
+	 * 网格构建、邻居搜索、lambda 与位置增量都按 grain 个粒子切块，交给工作窃取线程池执行
+	 * 位置增量采用 Jacobi 方式：先写入 delta 缓冲，全部算完后再统一加到位置上，
+	 * 结果与线程数和调度顺序无关
+	 */
+	int threadNums = 0; // 求解器线程数，0 表示使用硬件线程数
+	std::size_t grain = 512; // 每个任务块的粒子数
+	std::unique_ptr<ThreadPool> pool;
+	AlignedVector<float> deltaX, deltaY, deltaZ; // 位置增量（Jacobi）
+	std::vector<uint32_t> neighbourCount; // 每个粒子的邻居数
+	std::vector<std::vector<uint32_t>> chunkNeighbours; // 每个任务块内粒子的邻居下标，跨帧复用容量
+	std::vector<uint32_t> chunkDropped; // 每个任务块超出邻居数上限的邻居数
+	void parallelFor(std::size_t n, std::size_t chunk, const ThreadPool::RangeFn &fn);
+	std::vector<float> threadMax; // parallelMax 中每个线程的局部最大值
+	template <class Fn> float parallelMax(Fn &&value); // 并行求 max(value(i))，结果不小于 0
+	std::vector<double> threadSum; // 每个线程的局部和
+	void searchNeighbours();
+
+	// ----------- SIMD 核函数 ----------
+	const sph::KernelDispatch* kernels = &Kernel::dispatch(sph::SimdLevel::AVX512); // lambda / 位置增量循环使用的批量核函数
+	sph::KernelConstants kernelConstants() const; // 批量核函数使用的常量
+
+	// ----------- 邻居表复用（Verlet skin） ----------
+	/*
+	 * 以 neighbourRadius + skin 为半径搜索邻居并保留邻居表，
+	 * 只有当某个粒子相对上次构建时的位移超过 skin / 2 时才重建网格与邻居表。
+	 * 核函数仍按 neighbourRadius 截断，多出来的邻居不参与计算
+	 */
+	float neighbourSkin = 0.0f; // 0 表示关闭，每步都重建
+	bool neighboursValid = false; // 邻居表是否可以在下一步复用
+	AlignedVector<float> buildX, buildY, buildZ; // 上次构建邻居表时的粒子位置
+	uint32_t neighbourCapacity() const; // 每个粒子的邻居数上限，开启 skin 时按搜索球体积放大
+	float maxDisplacementSq(); // 自上次构建以来粒子的最大位移平方
+
+	// ----------- 对称邻居对遍历 ----------
+	/*
+	 * W_ij = W_ji、∇_i W_ij = -∇_j W_ij，每对邻居只计算一次核函数，结果同时累加到 i 与 j：
+	 *  邻居表中每个粒子 j > i 的邻居排在前面，共 neighbourHalf[i] 个，成对遍历只访问这一段
+	 *  写入 j 的冲突用网格着色避免：网格按坐标 mod 3 分成 27 种颜色，同色网格至少相隔 3 个网格，
+	 *  27 邻域互不相交，同一颜色内按网格并行、直接写入两侧粒子，不需要原子操作或线程私有缓冲
+	 *  每个粒子在每种颜色中只被一个网格写入，累加顺序固定，结果与线程数无关
+	 * 核函数调用次数减半，但写入 j 无法使用 SIMD 批量核函数，是否更快取决于邻居数与指令集
+	 */
+	static constexpr int kColours = 27;
+	bool symmetricPairs = false;
+	std::vector<uint32_t> neighbourHalf; // 每个粒子 j > i 的邻居数
+	std::array<uint32_t, kColours + 1> colourStart{}; // 颜色 c 的网格为 colourCells[colourStart[c], colourStart[c + 1])
+	std::vector<uint32_t> colourCells; // 按颜色排好序的非空网格槽
+	AlignedVector<float> pairGradSq; // 成对计算 lambda 时 Σ|∇W|² 的累加缓冲
+	void buildCellColours(); // 在 buildGrid 中为非空网格着色
+	// 对每对邻居 (i < j, 0 < r² < cutoff2) 调用一次 pair(i, j, sx, sy, sz, r2)，s = x_i - x_j
+	template <class Fn> void forEachPair(float cutoff2, Fn &&pair);
+	DensityError computeLambdaPairs();
+	void applyDeltaPairs();
+
+	/*
+	 * 邻居对缓存：
+	 *  同一次迭代中 lambda 与位置增量使用相同的位置，两者对每个邻居计算的距离、W 与 ∇W 完全相同
+	 *  开启后 computeLambda 把 W 与 ∇W 按邻居表的顺序写入 pairW / pairGX / pairGY / pairGZ，
+	 *  applyDelta 只需读缓存并 gather 邻居的 lambda，结果与重新计算一致
+	 *  每个邻居表项 16 字节（邻居表本身 4 字节），applyDelta 移动粒子后缓存失效；热启动的那次 applyDelta 重新计算
+	 *  对称邻居对遍历开启时不使用缓存
+	 */
+	bool pairCacheEnabled = false;
+	bool pairCacheValid = false; // 缓存是否对应当前位置与邻居表
+	AlignedVector<float> pairW, pairGX, pairGY, pairGZ;
+	sph::PairCache pairCacheAt(uint32_t first); // 邻居表第 first 项对应的缓存位置
+
 	// ----------- PBF参数 ----------
-	int pbfNumIters = 5; // PBF迭代次数，默认5次
-	float h = 1.1; // 粒子核函数的半径，确定粒子相互作用的范围，默认1.1，单位：世界坐标单位
+	int pbfNumIters = 5; // PBF迭代次数，默认5次；开启提前结束时为上限
+	float densityTolerance = 0.0f; // 平均密度误差阈值，0 表示关闭提前结束
+	bool warmStart = false; // 是否用上一步的 lambda 预先修正一次位置
+	int lastIterations = 0;
+	DensityError lastDensityError;
+	PhaseTimings phaseTimings;
+	StepStats stepStats;
+	static constexpr float h = Kernel::h; // 粒子核函数的半径，确定粒子相互作用的范围，由核函数策略给出，默认1.1，单位：世界坐标单位
 	float mass = 1.0, rho = 1.0; // 粒子质量，默认1.0，单位：世界坐标单位, 粒子静止密度，默认1.0(水)，单位：世界坐标单位
 	float lambdaEpsilon = 100.0; // 求解拉格朗日乘子的参数，防止求解零矩阵，默认100.0
+	float corrDeltaQCooff = 0.3f, corrK = 0.001f; // 人工压力 scorr 的参数 Δq / h 与 k，默认0.3, 0.001，由 kernelConstants 换算
 	/* 以下是XSPH对PBF的修正
 	 * XSPH基本思想：
-	 *  让粒子倾向于向周围粒子的平均位置移动
-	 *  通过添加一个与邻居粒子位置差相关的修正项，抑制非物理运动。
-	 *
+	 *  让粒子倾向于向周围粒子的平均速度靠拢：v_i += c * Σ (m / ρ) (v_j - v_i) W_ij
+	 *  抑制非物理的抖动，相当于人工粘性。
+	 * 涡量约束（Macklin 2013）：
+	 *  ω_i = Σ (v_j - v_i) × ∇_j W_ij，N = ∇|ω| / |∇|ω||，v_i += dt * ε (N × ω_i)
+	 *  把数值耗散掉的旋转能量补回来。∇|ω| 用上一步的 |ω|（ParticleStore::vorticity），
+	 *  这样两者与速度更新只需要一次邻居遍历；邻居的速度直接由位移 (x_j - oldX_j) / dt 求得
 	 */
-	float corrDeltaQCooff = 0.3f, corrK = 0.001; // XSPH参数，默认0.3, 0.001
+	float xsphViscosity = 0.0f; // XSPH 系数 c，常用 0.01
+	float vorticityEpsilon = 0.0f; // 涡量约束系数 ε
+	AlignedVector<float> vorticityNext; // 本步的 |ω|，遍历结束后与 particles.vorticity 交换
 
-	bool isInRange(const Eigen::Vector3i &cell);
+	uint64_t computeMortonCode(const Eigen::Vector3f &pos) const; // 63 位 Morton 码，每轴 21 位
 
-	unsigned int computeMortonCode(Eigen::Vector3f pos);
+	// ----------- Z 序重排 ----------
+	int reorderInterval = 25; // 每隔多少步重排一次粒子内存，0 表示关闭
+	int stepCount = 0; // 已执行的 PBF 步数
+	std::vector<uint64_t> mortonKeys, mortonKeyScratch;
+	std::vector<uint32_t> reorderIndex, reorderIndexScratch;
+	AlignedVector<float> reorderScratch;
+	std::vector<uint32_t> idScratch;
+
+	// ----------- 帧导出 ----------
+	FrameExporter *frameExporter = nullptr;
+	void exportFrame(); // 拷贝当前粒子状态并提交给导出器
 };
+
+using Simulator = BasicSimulator<sph::Poly6Spiky<>, sph::ClampBoundary>; // 默认配置
+using CubicSplineSimulator = BasicSimulator<sph::CubicSpline<>, sph::ClampBoundary>;
+using WendlandSimulator = BasicSimulator<sph::WendlandC2<>, sph::ClampBoundary>;
+using MarginSimulator = BasicSimulator<sph::Poly6Spiky<>, sph::MarginBoundary>; // 边界处理与 GPU 着色器一致
 #endif
\ No newline at end of file
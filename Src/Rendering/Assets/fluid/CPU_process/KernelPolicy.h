@@ -0,0 +1,170 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_KERNELPOLICY_H
+#define LEARNOPENGL_KERNELPOLICY_H
+
+#include <cmath>
+
+#include "SPHKernelsSIMD.h"
+
+/*
+ * SPH 核函数策略，作为 BasicSimulator 的模板参数
+ *  核半径 H 是模板参数，所有系数都是 constexpr，内层循环中没有关于 h 的除法和分支
+ *  每个策略提供：
+ *   w(r, r2)       核函数值 W(r)，r2 = r^2，0 < r < h
+ *   gradFactor(r)  梯度系数，∇W(s) = gradFactor(r) * s
+ *   dispatch(lvl)  lambda / 位置增量循环使用的批量实现（含邻居对缓存版本）
+ */
+namespace sph {
+
+constexpr float kPi = 3.14159265358979323846f;
+
+// 通用的标量批量实现，供没有专门 SIMD 版本的核函数使用
+template<class Kernel>
+LambdaSums lambdaBatch(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                       float xi, float yi, float zi, const KernelConstants& k) {
+	LambdaSums out{};
+	for (uint32_t n = 0; n < count; n++) {
+		const uint32_t j = nbr[n];
+		const float sx = xi - p.x[j], sy = yi - p.y[j], sz = zi - p.z[j];
+		const float r2 = sx * sx + sy * sy + sz * sz;
+		if (r2 <= 0.0f || r2 >= k.cutoff2) continue;
+		const float r = std::sqrt(r2);
+		const float g = Kernel::gradFactor(r);
+		const float gx = sx * g, gy = sy * g, gz = sz * g;
+		out.density += Kernel::w(r, r2);
+		out.gradX += gx;
+		out.gradY += gy;
+		out.gradZ += gz;
+		out.sumSqrGrad += gx * gx + gy * gy + gz * gz;
+	}
+	return out;
+}
+
+template<class Kernel>
+DeltaSums deltaBatch(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                     float xi, float yi, float zi, float lambdaI, const KernelConstants& k) {
+	DeltaSums out{};
+	for (uint32_t n = 0; n < count; n++) {
+		const uint32_t j = nbr[n];
+		const float sx = xi - p.x[j], sy = yi - p.y[j], sz = zi - p.z[j];
+		const float r2 = sx * sx + sy * sy + sz * sz;
+		if (r2 <= 0.0f || r2 >= k.cutoff2) continue;
+		const float r = std::sqrt(r2);
+		float t = Kernel::w(r, r2) * k.invRefPoly6;
+		t = t * t;
+		const float coef = (lambdaI + p.lambda[j] + k.scorrK * t * t) * Kernel::gradFactor(r);
+		out.x += coef * sx;
+		out.y += coef * sy;
+		out.z += coef * sz;
+	}
+	return out;
+}
+
+// 与 lambdaBatch 相同，同时把每个邻居的 W 与 ∇W 写入缓存
+template<class Kernel>
+LambdaSums lambdaBatchCached(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                             float xi, float yi, float zi, const KernelConstants& k, const PairCache& out) {
+	LambdaSums sums{};
+	for (uint32_t n = 0; n < count; n++) {
+		const uint32_t j = nbr[n];
+		const float sx = xi - p.x[j], sy = yi - p.y[j], sz = zi - p.z[j];
+		const float r2 = sx * sx + sy * sy + sz * sz;
+		if (r2 <= 0.0f || r2 >= k.cutoff2) {
+			out.w[n] = out.gx[n] = out.gy[n] = out.gz[n] = 0.0f;
+			continue;
+		}
+		const float r = std::sqrt(r2);
+		const float g = Kernel::gradFactor(r);
+		const float gx = sx * g, gy = sy * g, gz = sz * g;
+		const float w = Kernel::w(r, r2);
+		out.w[n] = w;
+		out.gx[n] = gx;
+		out.gy[n] = gy;
+		out.gz[n] = gz;
+		sums.density += w;
+		sums.gradX += gx;
+		sums.gradY += gy;
+		sums.gradZ += gz;
+		sums.sumSqrGrad += gx * gx + gy * gy + gz * gz;
+	}
+	return sums;
+}
+
+// Poly6 求密度、Spiky 求梯度（Müller 2003），有 AVX2 / AVX-512 实现
+template<float H = 1.1f>
+struct Poly6Spiky {
+	static constexpr const char* name = "poly6/spiky";
+	static constexpr float h = H, h2 = H * H;
+	static constexpr float poly6Coeff = 315.0f / (64.0f * kPi * h2 * h2 * h2 * h2 * h); // 315 / (64π h^9)
+	static constexpr float spikyCoeff = -45.0f / (kPi * h2 * h2 * h2);                  // -45 / (π h^6)
+
+	static constexpr float w(float, float r2) {
+		const float d = h2 - r2;
+		return poly6Coeff * d * d * d;
+	}
+	static constexpr float gradFactor(float r) {
+		const float d = h - r;
+		return spikyCoeff * d * d / r;
+	}
+
+	static const KernelDispatch& dispatch(SimdLevel level) { return selectKernels(level); }
+};
+
+// 三次样条核（Monaghan 1992），支撑半径为 h
+template<float H = 1.1f>
+struct CubicSpline {
+	static constexpr const char* name = "cubic spline";
+	static constexpr float h = H, invH = 1.0f / H;
+	static constexpr float sigma = 8.0f / (kPi * H * H * H);      // 8 / (π h^3)
+	static constexpr float gradSigma = 48.0f / (kPi * H * H * H * H); // 6σ / h
+
+	static constexpr float w(float r, float) {
+		const float q = r * invH;
+		const float a = 1.0f - q;
+		return q <= 0.5f ? sigma * (6.0f * q * q * (q - 1.0f) + 1.0f) : sigma * 2.0f * a * a * a;
+	}
+	static constexpr float gradFactor(float r) {
+		const float q = r * invH;
+		const float a = 1.0f - q;
+		// dW/dr / r
+		return q <= 0.5f ? gradSigma * (3.0f * q - 2.0f) * invH : -gradSigma * a * a / r;
+	}
+
+	static const KernelDispatch& dispatch(SimdLevel) {
+		static const KernelDispatch scalar{SimdLevel::Scalar, lambdaBatch<CubicSpline>, deltaBatch<CubicSpline>,
+		                                   lambdaBatchCached<CubicSpline>, deltaCachedScalar};
+		return scalar;
+	}
+};
+
+// Wendland C2 核（3D），梯度中不含 1/r
+template<float H = 1.1f>
+struct WendlandC2 {
+	static constexpr const char* name = "Wendland C2";
+	static constexpr float h = H, invH = 1.0f / H;
+	static constexpr float sigma = 21.0f / (2.0f * kPi * H * H * H);          // 21 / (2π h^3)
+	static constexpr float gradSigma = -210.0f / (kPi * H * H * H * H * H); // -20σ / h^2
+
+	static constexpr float w(float r, float) {
+		const float q = r * invH;
+		const float a = 1.0f - q;
+		return sigma * a * a * a * a * (1.0f + 4.0f * q);
+	}
+	static constexpr float gradFactor(float r) {
+		const float a = 1.0f - r * invH;
+		return gradSigma * a * a * a;
+	}
+
+	static const KernelDispatch& dispatch(SimdLevel) {
+		static const KernelDispatch scalar{SimdLevel::Scalar, lambdaBatch<WendlandC2>, deltaBatch<WendlandC2>,
+		                                   lambdaBatchCached<WendlandC2>, deltaCachedScalar};
+		return scalar;
+	}
+};
+
+} // namespace sph
+
+#endif //LEARNOPENGL_KERNELPOLICY_H
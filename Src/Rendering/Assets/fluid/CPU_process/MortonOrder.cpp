@@ -0,0 +1,52 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "MortonOrder.h"
+
+#include <array>
+#include <numeric>
+#include <utility>
+
+namespace morton {
+
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+               std::vector<uint64_t>& keyScratch, std::vector<uint32_t>& orderScratch) {
+	const std::size_t n = keys.size();
+	order.resize(n);
+	keyScratch.resize(n);
+	orderScratch.resize(n);
+	std::iota(order.begin(), order.end(), 0u);
+	if (n < 2) return;
+
+	// 一次遍历统计全部 8 个字节的直方图
+	std::array<std::array<uint32_t, 256>, 8> histogram{};
+	for (uint64_t key : keys) {
+		for (int pass = 0; pass < 8; pass++) {
+			histogram[pass][(key >> (pass * 8)) & 0xff]++;
+		}
+	}
+
+	for (int pass = 0; pass < 8; pass++) {
+		auto& count = histogram[pass];
+		const int shift = pass * 8;
+		// 这一字节所有键都相同，排序不会改变顺序，直接跳过
+		if (count[(keys[0] >> shift) & 0xff] == n) continue;
+
+		uint32_t running = 0;
+		for (auto& c : count) {
+			const uint32_t tmp = c;
+			c = running;
+			running += tmp;
+		}
+		for (std::size_t i = 0; i < n; i++) {
+			const uint32_t dst = count[(keys[i] >> shift) & 0xff]++;
+			keyScratch[dst] = keys[i];
+			orderScratch[dst] = order[i];
+		}
+		keys.swap(keyScratch);
+		order.swap(orderScratch);
+	}
+}
+
+} // namespace morton
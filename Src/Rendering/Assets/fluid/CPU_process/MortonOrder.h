@@ -0,0 +1,53 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_MORTONORDER_H
+#define LEARNOPENGL_MORTONORDER_H
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+	#include <immintrin.h>
+	#define FLUID_HAS_BMI2 1
+#endif
+
+namespace morton {
+
+constexpr int kBitsPerAxis = 21; // 3 * 21 = 63 位
+constexpr uint32_t kAxisMax = (1u << kBitsPerAxis) - 1;
+
+// 把 21 位整数的每一位之间插入两个 0
+inline uint64_t spreadBits3(uint32_t v) {
+#ifdef FLUID_HAS_BMI2
+	return _pdep_u64(v, 0x1249249249249249ull);
+#else
+	uint64_t x = v & kAxisMax;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x << 8) & 0x100f00f00f00f00full;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+	x = (x | x << 2) & 0x1249249249249249ull;
+	return x;
+#endif
+}
+
+// 63 位交错编码：x 在最低位，依次为 y、z
+inline uint64_t encode3(uint32_t x, uint32_t y, uint32_t z) {
+	return spreadBits3(x) | spreadBits3(y) << 1 | spreadBits3(z) << 2;
+}
+
+/*
+ * @brief: 按 64 位键做 LSD 基数排序（每趟 8 位），输出排序后的原始下标
+ * @param keys: 排序键，排序过程中会被改写
+ * @param order: 输出，order[k] 为排序后第 k 个元素的原始下标
+ * @param keyScratch, orderScratch: 与 keys 等长的临时缓冲，由调用方复用以避免分配
+ * 所有键相同的字节会被跳过，对 63 位 Morton 码通常只需要 5~6 趟
+ */
+void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order,
+               std::vector<uint64_t>& keyScratch, std::vector<uint32_t>& orderScratch);
+
+} // namespace morton
+
+#endif //LEARNOPENGL_MORTONORDER_H
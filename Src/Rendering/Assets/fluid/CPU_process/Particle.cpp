@@ -4,14 +4,55 @@
 
 #include "Particle.h"
 
-Particle::Particle(Eigen::Vector3f pos, Eigen::Vector3f vel, float density, int _h) {
-	this->pos = pos;
-	this->vel = vel;
-	this->density = density;
-	this->_h = _h;
+void ParticleStore::reserve(std::size_t n) {
+	for (auto* a : {&x, &y, &z, &vx, &vy, &vz, &oldX, &oldY, &oldZ, &lambda, &density, &vorticity}) {
+		a->reserve(n);
+	}
+	id.reserve(n);
 }
-bool Particle::operator==(const Particle &rhs) const {
-    return pos.isApprox(rhs.pos) &&
-		   vel.isApprox(rhs.vel) &&
-	       density == rhs.density;
+void ParticleStore::clear() {
+	for (auto* a : {&x, &y, &z, &vx, &vy, &vz, &oldX, &oldY, &oldZ, &lambda, &density, &vorticity}) {
+		a->clear();
+	}
+	id.clear();
+}
+void ParticleStore::resize(std::size_t n) {
+	for (auto* a : {&x, &y, &z, &vx, &vy, &vz, &oldX, &oldY, &oldZ, &lambda, &density, &vorticity}) {
+		a->resize(n);
+	}
+	id.resize(n);
+}
+void ParticleStore::push_back(const Eigen::Vector3f& pos, const Eigen::Vector3f& vel, float rho) {
+	x.push_back(pos.x()); y.push_back(pos.y()); z.push_back(pos.z());
+	vx.push_back(vel.x()); vy.push_back(vel.y()); vz.push_back(vel.z());
+	oldX.push_back(pos.x()); oldY.push_back(pos.y()); oldZ.push_back(pos.z());
+	lambda.push_back(0.0f);
+	density.push_back(rho);
+	vorticity.push_back(0.0f);
+	id.push_back(static_cast<uint32_t>(id.size()));
+}
+void ParticleStore::permute(const std::vector<uint32_t>& order, AlignedVector<float>& scratch, std::vector<uint32_t>& idScratch) {
+	const std::size_t n = size();
+	scratch.resize(n);
+	idScratch.resize(n);
+	for (auto* a : {&x, &y, &z, &vx, &vy, &vz, &oldX, &oldY, &oldZ, &lambda, &density, &vorticity}) {
+		const float* src = a->data();
+		for (std::size_t k = 0; k < n; k++) {
+			scratch[k] = src[order[k]];
+		}
+		a->swap(scratch); // 交换缓冲区，原数组成为下一个属性的临时缓冲
+	}
+	for (std::size_t k = 0; k < n; k++) {
+		idScratch[k] = id[order[k]];
+	}
+	id.swap(idScratch);
+}
+
+void NeighbourList::reserve(std::size_t particleNums, std::size_t maxNeighbour) {
+	offsets.reserve(particleNums + 1);
+	indices.reserve(particleNums * maxNeighbour);
+}
+void NeighbourList::clear() {
+	offsets.clear();
+	indices.clear();
 }
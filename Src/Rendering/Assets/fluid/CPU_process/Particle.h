@@ -11,23 +11,82 @@
 	#include <Eigen/Eigen>
 #endif
 
+#include <cstdint>
+#include <span>
 #include <vector>
 
-class Particle {
-public:
-	Particle() = default;
-	Particle(Eigen::Vector3f pos, Eigen::Vector3f vel = Eigen::Vector3f::Zero(), float density = 1.0f, int _h = 100);
-    Eigen::Vector3f pos; // 粒子位置
-    Eigen::Vector3f vel; // 粒子速度
-	Eigen::Vector3f oldPos;
-	float lambda; // 拉格朗日乘子
-    float density; // 粒子密度（使用sph方法）
-	int _h; // 最大邻居数
-	std::vector<Particle*> neighbour; // 邻居粒子
-	~Particle() = default;
-
-	bool operator==(const Particle& rhs) const;
+#include "AlignedAllocator.h"
+
+/*
+ * 粒子数据采用 SoA（Structure of Arrays）布局：
+ *  每个属性独立存放在 64 字节对齐的连续数组中，
+ *  lambda / delta 等循环只读取需要的分量，按下标线性访问内存。
+ * 粒子之间通过下标（而不是指针）互相引用，便于后续重排与并行。
+ */
+struct ParticleStore {
+	AlignedVector<float> x, y, z;          // 粒子位置
+	AlignedVector<float> vx, vy, vz;       // 粒子速度
+	AlignedVector<float> oldX, oldY, oldZ; // 上一帧位置
+	AlignedVector<float> lambda;           // 拉格朗日乘子
+	AlignedVector<float> density;          // 粒子密度（使用sph方法）
+	AlignedVector<float> vorticity;        // 上一步的涡量大小 |ω|，涡量约束求梯度用
+	std::vector<uint32_t> id;              // 粒子的原始编号，重排后保持不变
+
+	[[nodiscard]] std::size_t size() const { return x.size(); }
+	void reserve(std::size_t n);
+	void clear();
+	void resize(std::size_t n); // 新增的粒子属性（含编号）值初始化为 0，之后由调用方整体写入（如从快照拷贝）
+	void push_back(const Eigen::Vector3f& pos, const Eigen::Vector3f& vel = Eigen::Vector3f::Zero(), float rho = 1.0f);
+	/*
+	 * @brief: 按 order 重排所有属性，重排后第 k 个粒子为原来的第 order[k] 个粒子
+	 * @param scratch: 与粒子数等长的临时缓冲，由调用方复用以避免分配
+	 */
+	void permute(const std::vector<uint32_t>& order, AlignedVector<float>& scratch, std::vector<uint32_t>& idScratch);
+
+	[[nodiscard]] Eigen::Vector3f pos(std::size_t i) const { return {x[i], y[i], z[i]}; }
+	[[nodiscard]] Eigen::Vector3f vel(std::size_t i) const { return {vx[i], vy[i], vz[i]}; }
+	[[nodiscard]] Eigen::Vector3f oldPos(std::size_t i) const { return {oldX[i], oldY[i], oldZ[i]}; }
+	void setPos(std::size_t i, const Eigen::Vector3f& p) { x[i] = p.x(); y[i] = p.y(); z[i] = p.z(); }
+	void setVel(std::size_t i, const Eigen::Vector3f& v) { vx[i] = v.x(); vy[i] = v.y(); vz[i] = v.z(); }
+};
+
+/*
+ * 压缩行存储（CSR）的邻居表：
+ *  粒子 i 的邻居下标为 indices[offsets[i], offsets[i + 1])
+ *  每步整体重建一次，容量在 init 时按 粒子数 * 最大邻居数 预留，运行期不再分配内存
+ *  并行构建时各任务块先写入自己的缓冲，再按 offsets 拷贝到 indices 中
+ */
+struct NeighbourList {
+	std::vector<uint32_t> offsets; // 长度 = 粒子数 + 1
+	std::vector<uint32_t> indices; // 所有粒子的邻居下标首尾相接
+
+	void reserve(std::size_t particleNums, std::size_t maxNeighbour);
+	void clear();
+
+	[[nodiscard]] uint32_t begin(std::size_t i) const { return offsets[i]; }
+	[[nodiscard]] uint32_t end(std::size_t i) const { return offsets[i + 1]; }
+	[[nodiscard]] uint32_t count(std::size_t i) const { return offsets[i + 1] - offsets[i]; }
+};
+
+// 粒子位置的只读视图，不发生拷贝
+struct ParticlePosView {
+	std::span<const float> x, y, z;
+
+	[[nodiscard]] std::size_t size() const { return x.size(); }
+	[[nodiscard]] Eigen::Vector3f operator[](std::size_t i) const { return {x[i], y[i], z[i]}; }
 };
 
+// 粒子全部属性的只读视图，不发生拷贝
+struct ParticleView {
+	std::span<const float> x, y, z;
+	std::span<const float> vx, vy, vz;
+	std::span<const float> lambda;
+	std::span<const float> density;
+	std::span<const uint32_t> id;
+
+	[[nodiscard]] std::size_t size() const { return x.size(); }
+	[[nodiscard]] Eigen::Vector3f pos(std::size_t i) const { return {x[i], y[i], z[i]}; }
+	[[nodiscard]] Eigen::Vector3f vel(std::size_t i) const { return {vx[i], vy[i], vz[i]}; }
+};
 
 #endif //PARTICLE_H
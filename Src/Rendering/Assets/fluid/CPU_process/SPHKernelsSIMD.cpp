@@ -0,0 +1,391 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "SPHKernelsSIMD.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define FLUID_SIMD_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define FLUID_TARGET_AVX2
+		#define FLUID_TARGET_AVX512
+	#else
+		#define FLUID_TARGET_AVX2 __attribute__((target("avx2,fma")))
+		#define FLUID_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+	#endif
+#endif
+
+namespace sph {
+
+// ----------- 标量实现 -----------
+namespace {
+
+// Store 为 true 时同时写入邻居对缓存 cache
+template<bool Store>
+LambdaSums lambdaScalarImpl(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                            float xi, float yi, float zi, const KernelConstants& k, const PairCache* cache) {
+	LambdaSums out{};
+	for (uint32_t n = 0; n < count; n++) {
+		const uint32_t j = nbr[n];
+		const float sx = xi - p.x[j], sy = yi - p.y[j], sz = zi - p.z[j];
+		const float r2 = sx * sx + sy * sy + sz * sz;
+		if (r2 <= 0.0f || r2 >= k.cutoff2) {
+			if constexpr (Store) cache->w[n] = cache->gx[n] = cache->gy[n] = cache->gz[n] = 0.0f;
+			continue;
+		}
+		const float r = std::sqrt(r2);
+		const float d = k.h2 - r2;
+		const float hr = k.h - r;
+		const float g = k.spikyCoeff * hr * hr / r;
+		const float gx = sx * g, gy = sy * g, gz = sz * g;
+		const float w = k.poly6Coeff * d * d * d;
+		if constexpr (Store) {
+			cache->w[n] = w;
+			cache->gx[n] = gx;
+			cache->gy[n] = gy;
+			cache->gz[n] = gz;
+		}
+		out.density += w;
+		out.gradX += gx;
+		out.gradY += gy;
+		out.gradZ += gz;
+		out.sumSqrGrad += gx * gx + gy * gy + gz * gz;
+	}
+	return out;
+}
+
+LambdaSums lambdaScalar(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                        float xi, float yi, float zi, const KernelConstants& k) {
+	return lambdaScalarImpl<false>(p, nbr, count, xi, yi, zi, k, nullptr);
+}
+
+LambdaSums lambdaCachedScalar(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                              float xi, float yi, float zi, const KernelConstants& k, const PairCache& out) {
+	return lambdaScalarImpl<true>(p, nbr, count, xi, yi, zi, k, &out);
+}
+
+DeltaSums deltaScalar(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                      float xi, float yi, float zi, float lambdaI, const KernelConstants& k) {
+	DeltaSums out{};
+	for (uint32_t n = 0; n < count; n++) {
+		const uint32_t j = nbr[n];
+		const float sx = xi - p.x[j], sy = yi - p.y[j], sz = zi - p.z[j];
+		const float r2 = sx * sx + sy * sy + sz * sz;
+		if (r2 <= 0.0f || r2 >= k.cutoff2) continue;
+		const float r = std::sqrt(r2);
+		const float d = k.h2 - r2;
+		const float hr = k.h - r;
+		float t = k.poly6Coeff * d * d * d * k.invRefPoly6;
+		t = t * t;
+		const float scorr = k.scorrK * t * t;
+		const float coef = (lambdaI + p.lambda[j] + scorr) * k.spikyCoeff * hr * hr / r;
+		out.x += coef * sx;
+		out.y += coef * sy;
+		out.z += coef * sz;
+	}
+	return out;
+}
+
+// ----------- AVX2：一次 8 个邻居 -----------
+#ifdef FLUID_SIMD_X86
+
+FLUID_TARGET_AVX2 inline float hsum256(__m256 v) {
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_movehdup_ps(s));
+	return _mm_cvtss_f32(s);
+}
+
+template<bool Store>
+FLUID_TARGET_AVX2 LambdaSums lambdaAVX2Impl(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                            float xi, float yi, float zi, const KernelConstants& k,
+                                            const PairCache* cache) {
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 vxi = _mm256_set1_ps(xi), vyi = _mm256_set1_ps(yi), vzi = _mm256_set1_ps(zi);
+	const __m256 vh = _mm256_set1_ps(k.h), vh2 = _mm256_set1_ps(k.h2);
+	const __m256 vcut = _mm256_set1_ps(k.cutoff2);
+	const __m256 c6 = _mm256_set1_ps(k.poly6Coeff), cs = _mm256_set1_ps(k.spikyCoeff);
+	__m256 accW = zero, accX = zero, accY = zero, accZ = zero, accSq = zero;
+	for (uint32_t b = 0; b < count; b += 8) {
+		// 尾部不足 8 个时，用掩码屏蔽多余的通道，不会越界读取
+		const __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - b)), lane);
+		const __m256 liveMask = _mm256_castsi256_ps(live);
+		const __m256i idx = _mm256_maskload_epi32(reinterpret_cast<const int*>(nbr + b), live);
+		const __m256 sx = _mm256_sub_ps(vxi, _mm256_mask_i32gather_ps(zero, p.x, idx, liveMask, 4));
+		const __m256 sy = _mm256_sub_ps(vyi, _mm256_mask_i32gather_ps(zero, p.y, idx, liveMask, 4));
+		const __m256 sz = _mm256_sub_ps(vzi, _mm256_mask_i32gather_ps(zero, p.z, idx, liveMask, 4));
+		const __m256 r2 = _mm256_fmadd_ps(sx, sx, _mm256_fmadd_ps(sy, sy, _mm256_mul_ps(sz, sz)));
+		const __m256 valid = _mm256_and_ps(liveMask, _mm256_and_ps(_mm256_cmp_ps(r2, zero, _CMP_GT_OQ),
+		                                                           _mm256_cmp_ps(r2, vcut, _CMP_LT_OQ)));
+		const __m256 r = _mm256_sqrt_ps(r2);
+		const __m256 d = _mm256_sub_ps(vh2, r2);
+		const __m256 hr = _mm256_sub_ps(vh, r);
+		// 无效通道（r = 0 等）的结果会被掩码清零
+		const __m256 w = _mm256_and_ps(valid, _mm256_mul_ps(c6, _mm256_mul_ps(d, _mm256_mul_ps(d, d))));
+		const __m256 g = _mm256_and_ps(valid, _mm256_div_ps(_mm256_mul_ps(cs, _mm256_mul_ps(hr, hr)), r));
+		const __m256 gx = _mm256_mul_ps(sx, g), gy = _mm256_mul_ps(sy, g), gz = _mm256_mul_ps(sz, g);
+		if constexpr (Store) {
+			_mm256_maskstore_ps(cache->w + b, live, w);
+			_mm256_maskstore_ps(cache->gx + b, live, gx);
+			_mm256_maskstore_ps(cache->gy + b, live, gy);
+			_mm256_maskstore_ps(cache->gz + b, live, gz);
+		}
+		accW = _mm256_add_ps(accW, w);
+		accX = _mm256_add_ps(accX, gx);
+		accY = _mm256_add_ps(accY, gy);
+		accZ = _mm256_add_ps(accZ, gz);
+		accSq = _mm256_fmadd_ps(gx, gx, _mm256_fmadd_ps(gy, gy, _mm256_fmadd_ps(gz, gz, accSq)));
+	}
+	return {hsum256(accW), hsum256(accX), hsum256(accY), hsum256(accZ), hsum256(accSq)};
+}
+
+FLUID_TARGET_AVX2 LambdaSums lambdaAVX2(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                        float xi, float yi, float zi, const KernelConstants& k) {
+	return lambdaAVX2Impl<false>(p, nbr, count, xi, yi, zi, k, nullptr);
+}
+
+FLUID_TARGET_AVX2 LambdaSums lambdaCachedAVX2(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                              float xi, float yi, float zi, const KernelConstants& k,
+                                              const PairCache& out) {
+	return lambdaAVX2Impl<true>(p, nbr, count, xi, yi, zi, k, &out);
+}
+
+FLUID_TARGET_AVX2 DeltaSums deltaAVX2(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                      float xi, float yi, float zi, float lambdaI, const KernelConstants& k) {
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 vxi = _mm256_set1_ps(xi), vyi = _mm256_set1_ps(yi), vzi = _mm256_set1_ps(zi);
+	const __m256 vh = _mm256_set1_ps(k.h), vh2 = _mm256_set1_ps(k.h2);
+	const __m256 vcut = _mm256_set1_ps(k.cutoff2);
+	const __m256 c6 = _mm256_set1_ps(k.poly6Coeff * k.invRefPoly6), cs = _mm256_set1_ps(k.spikyCoeff);
+	const __m256 ck = _mm256_set1_ps(k.scorrK), vli = _mm256_set1_ps(lambdaI);
+	__m256 accX = zero, accY = zero, accZ = zero;
+	for (uint32_t b = 0; b < count; b += 8) {
+		const __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - b)), lane);
+		const __m256 liveMask = _mm256_castsi256_ps(live);
+		const __m256i idx = _mm256_maskload_epi32(reinterpret_cast<const int*>(nbr + b), live);
+		const __m256 sx = _mm256_sub_ps(vxi, _mm256_mask_i32gather_ps(zero, p.x, idx, liveMask, 4));
+		const __m256 sy = _mm256_sub_ps(vyi, _mm256_mask_i32gather_ps(zero, p.y, idx, liveMask, 4));
+		const __m256 sz = _mm256_sub_ps(vzi, _mm256_mask_i32gather_ps(zero, p.z, idx, liveMask, 4));
+		const __m256 lj = _mm256_mask_i32gather_ps(zero, p.lambda, idx, liveMask, 4);
+		const __m256 r2 = _mm256_fmadd_ps(sx, sx, _mm256_fmadd_ps(sy, sy, _mm256_mul_ps(sz, sz)));
+		const __m256 valid = _mm256_and_ps(liveMask, _mm256_and_ps(_mm256_cmp_ps(r2, zero, _CMP_GT_OQ),
+		                                                           _mm256_cmp_ps(r2, vcut, _CMP_LT_OQ)));
+		const __m256 r = _mm256_sqrt_ps(r2);
+		const __m256 d = _mm256_sub_ps(vh2, r2);
+		const __m256 hr = _mm256_sub_ps(vh, r);
+		__m256 t = _mm256_mul_ps(c6, _mm256_mul_ps(d, _mm256_mul_ps(d, d))); // W / W(Δq)
+		t = _mm256_mul_ps(t, t);
+		const __m256 scorr = _mm256_mul_ps(ck, _mm256_mul_ps(t, t));
+		const __m256 g = _mm256_div_ps(_mm256_mul_ps(cs, _mm256_mul_ps(hr, hr)), r);
+		const __m256 coef = _mm256_and_ps(valid, _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(vli, lj), scorr), g));
+		accX = _mm256_fmadd_ps(coef, sx, accX);
+		accY = _mm256_fmadd_ps(coef, sy, accY);
+		accZ = _mm256_fmadd_ps(coef, sz, accZ);
+	}
+	return {hsum256(accX), hsum256(accY), hsum256(accZ)};
+}
+
+FLUID_TARGET_AVX2 DeltaSums deltaCachedAVX2(const float* lambda, const uint32_t* nbr, uint32_t count,
+                                            const PairCache& in, float lambdaI, const KernelConstants& k) {
+	const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 ref = _mm256_set1_ps(k.invRefPoly6), ck = _mm256_set1_ps(k.scorrK), vli = _mm256_set1_ps(lambdaI);
+	__m256 accX = zero, accY = zero, accZ = zero;
+	for (uint32_t b = 0; b < count; b += 8) {
+		const __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count - b)), lane);
+		const __m256i idx = _mm256_maskload_epi32(reinterpret_cast<const int*>(nbr + b), live);
+		const __m256 lj = _mm256_mask_i32gather_ps(zero, lambda, idx, _mm256_castsi256_ps(live), 4);
+		// 截断半径外的邻居与尾部通道的 W、∇W 都是 0
+		__m256 t = _mm256_mul_ps(_mm256_maskload_ps(in.w + b, live), ref);
+		t = _mm256_mul_ps(t, t);
+		const __m256 coef = _mm256_add_ps(_mm256_add_ps(vli, lj), _mm256_mul_ps(ck, _mm256_mul_ps(t, t)));
+		accX = _mm256_fmadd_ps(coef, _mm256_maskload_ps(in.gx + b, live), accX);
+		accY = _mm256_fmadd_ps(coef, _mm256_maskload_ps(in.gy + b, live), accY);
+		accZ = _mm256_fmadd_ps(coef, _mm256_maskload_ps(in.gz + b, live), accZ);
+	}
+	return {hsum256(accX), hsum256(accY), hsum256(accZ)};
+}
+
+// ----------- AVX-512：一次 16 个邻居 -----------
+FLUID_TARGET_AVX512 inline __mmask16 tailMask16(uint32_t remain) {
+	return remain >= 16 ? static_cast<__mmask16>(0xffff) : static_cast<__mmask16>((1u << remain) - 1u);
+}
+
+template<bool Store>
+FLUID_TARGET_AVX512 LambdaSums lambdaAVX512Impl(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                                float xi, float yi, float zi, const KernelConstants& k,
+                                                const PairCache* cache) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 vxi = _mm512_set1_ps(xi), vyi = _mm512_set1_ps(yi), vzi = _mm512_set1_ps(zi);
+	const __m512 vh = _mm512_set1_ps(k.h), vh2 = _mm512_set1_ps(k.h2);
+	const __m512 vcut = _mm512_set1_ps(k.cutoff2);
+	const __m512 c6 = _mm512_set1_ps(k.poly6Coeff), cs = _mm512_set1_ps(k.spikyCoeff);
+	__m512 accW = zero, accX = zero, accY = zero, accZ = zero, accSq = zero;
+	for (uint32_t b = 0; b < count; b += 16) {
+		const __mmask16 live = tailMask16(count - b);
+		const __m512i idx = _mm512_maskz_loadu_epi32(live, nbr + b);
+		const __m512 sx = _mm512_sub_ps(vxi, _mm512_mask_i32gather_ps(zero, live, idx, p.x, 4));
+		const __m512 sy = _mm512_sub_ps(vyi, _mm512_mask_i32gather_ps(zero, live, idx, p.y, 4));
+		const __m512 sz = _mm512_sub_ps(vzi, _mm512_mask_i32gather_ps(zero, live, idx, p.z, 4));
+		const __m512 r2 = _mm512_fmadd_ps(sx, sx, _mm512_fmadd_ps(sy, sy, _mm512_mul_ps(sz, sz)));
+		const __mmask16 valid = _mm512_mask_cmp_ps_mask(live, r2, zero, _CMP_GT_OQ) &
+		                        _mm512_cmp_ps_mask(r2, vcut, _CMP_LT_OQ);
+		const __m512 r = _mm512_sqrt_ps(r2);
+		const __m512 d = _mm512_sub_ps(vh2, r2);
+		const __m512 hr = _mm512_sub_ps(vh, r);
+		const __m512 w = _mm512_mul_ps(c6, _mm512_mul_ps(d, _mm512_mul_ps(d, d)));
+		const __m512 g = _mm512_maskz_div_ps(valid, _mm512_mul_ps(cs, _mm512_mul_ps(hr, hr)), r);
+		const __m512 gx = _mm512_mul_ps(sx, g), gy = _mm512_mul_ps(sy, g), gz = _mm512_mul_ps(sz, g);
+		if constexpr (Store) {
+			_mm512_mask_storeu_ps(cache->w + b, live, _mm512_maskz_mov_ps(valid, w));
+			_mm512_mask_storeu_ps(cache->gx + b, live, gx);
+			_mm512_mask_storeu_ps(cache->gy + b, live, gy);
+			_mm512_mask_storeu_ps(cache->gz + b, live, gz);
+		}
+		accW = _mm512_mask_add_ps(accW, valid, accW, w);
+		accX = _mm512_add_ps(accX, gx);
+		accY = _mm512_add_ps(accY, gy);
+		accZ = _mm512_add_ps(accZ, gz);
+		accSq = _mm512_fmadd_ps(gx, gx, _mm512_fmadd_ps(gy, gy, _mm512_fmadd_ps(gz, gz, accSq)));
+	}
+	return {_mm512_reduce_add_ps(accW), _mm512_reduce_add_ps(accX), _mm512_reduce_add_ps(accY),
+	        _mm512_reduce_add_ps(accZ), _mm512_reduce_add_ps(accSq)};
+}
+
+FLUID_TARGET_AVX512 LambdaSums lambdaAVX512(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                            float xi, float yi, float zi, const KernelConstants& k) {
+	return lambdaAVX512Impl<false>(p, nbr, count, xi, yi, zi, k, nullptr);
+}
+
+FLUID_TARGET_AVX512 LambdaSums lambdaCachedAVX512(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                                  float xi, float yi, float zi, const KernelConstants& k,
+                                                  const PairCache& out) {
+	return lambdaAVX512Impl<true>(p, nbr, count, xi, yi, zi, k, &out);
+}
+
+FLUID_TARGET_AVX512 DeltaSums deltaAVX512(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                          float xi, float yi, float zi, float lambdaI, const KernelConstants& k) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 vxi = _mm512_set1_ps(xi), vyi = _mm512_set1_ps(yi), vzi = _mm512_set1_ps(zi);
+	const __m512 vh = _mm512_set1_ps(k.h), vh2 = _mm512_set1_ps(k.h2);
+	const __m512 vcut = _mm512_set1_ps(k.cutoff2);
+	const __m512 c6 = _mm512_set1_ps(k.poly6Coeff * k.invRefPoly6), cs = _mm512_set1_ps(k.spikyCoeff);
+	const __m512 ck = _mm512_set1_ps(k.scorrK), vli = _mm512_set1_ps(lambdaI);
+	__m512 accX = zero, accY = zero, accZ = zero;
+	for (uint32_t b = 0; b < count; b += 16) {
+		const __mmask16 live = tailMask16(count - b);
+		const __m512i idx = _mm512_maskz_loadu_epi32(live, nbr + b);
+		const __m512 sx = _mm512_sub_ps(vxi, _mm512_mask_i32gather_ps(zero, live, idx, p.x, 4));
+		const __m512 sy = _mm512_sub_ps(vyi, _mm512_mask_i32gather_ps(zero, live, idx, p.y, 4));
+		const __m512 sz = _mm512_sub_ps(vzi, _mm512_mask_i32gather_ps(zero, live, idx, p.z, 4));
+		const __m512 lj = _mm512_mask_i32gather_ps(zero, live, idx, p.lambda, 4);
+		const __m512 r2 = _mm512_fmadd_ps(sx, sx, _mm512_fmadd_ps(sy, sy, _mm512_mul_ps(sz, sz)));
+		const __mmask16 valid = _mm512_mask_cmp_ps_mask(live, r2, zero, _CMP_GT_OQ) &
+		                        _mm512_cmp_ps_mask(r2, vcut, _CMP_LT_OQ);
+		const __m512 r = _mm512_sqrt_ps(r2);
+		const __m512 d = _mm512_sub_ps(vh2, r2);
+		const __m512 hr = _mm512_sub_ps(vh, r);
+		__m512 t = _mm512_mul_ps(c6, _mm512_mul_ps(d, _mm512_mul_ps(d, d)));
+		t = _mm512_mul_ps(t, t);
+		const __m512 scorr = _mm512_mul_ps(ck, _mm512_mul_ps(t, t));
+		const __m512 g = _mm512_div_ps(_mm512_mul_ps(cs, _mm512_mul_ps(hr, hr)), r);
+		// 远处邻居的 scorr 可能溢出为 inf，必须按掩码清零而不是乘 0
+		const __m512 coef = _mm512_maskz_mul_ps(valid, _mm512_add_ps(_mm512_add_ps(vli, lj), scorr), g);
+		accX = _mm512_fmadd_ps(coef, sx, accX);
+		accY = _mm512_fmadd_ps(coef, sy, accY);
+		accZ = _mm512_fmadd_ps(coef, sz, accZ);
+	}
+	return {_mm512_reduce_add_ps(accX), _mm512_reduce_add_ps(accY), _mm512_reduce_add_ps(accZ)};
+}
+
+FLUID_TARGET_AVX512 DeltaSums deltaCachedAVX512(const float* lambda, const uint32_t* nbr, uint32_t count,
+                                                const PairCache& in, float lambdaI, const KernelConstants& k) {
+	const __m512 zero = _mm512_setzero_ps();
+	const __m512 ref = _mm512_set1_ps(k.invRefPoly6), ck = _mm512_set1_ps(k.scorrK), vli = _mm512_set1_ps(lambdaI);
+	__m512 accX = zero, accY = zero, accZ = zero;
+	for (uint32_t b = 0; b < count; b += 16) {
+		const __mmask16 live = tailMask16(count - b);
+		const __m512i idx = _mm512_maskz_loadu_epi32(live, nbr + b);
+		const __m512 lj = _mm512_mask_i32gather_ps(zero, live, idx, lambda, 4);
+		__m512 t = _mm512_mul_ps(_mm512_maskz_loadu_ps(live, in.w + b), ref);
+		t = _mm512_mul_ps(t, t);
+		const __m512 coef = _mm512_add_ps(_mm512_add_ps(vli, lj), _mm512_mul_ps(ck, _mm512_mul_ps(t, t)));
+		accX = _mm512_fmadd_ps(coef, _mm512_maskz_loadu_ps(live, in.gx + b), accX);
+		accY = _mm512_fmadd_ps(coef, _mm512_maskz_loadu_ps(live, in.gy + b), accY);
+		accZ = _mm512_fmadd_ps(coef, _mm512_maskz_loadu_ps(live, in.gz + b), accZ);
+	}
+	return {_mm512_reduce_add_ps(accX), _mm512_reduce_add_ps(accY), _mm512_reduce_add_ps(accZ)};
+}
+
+#endif // FLUID_SIMD_X86
+
+} // namespace
+
+DeltaSums deltaCachedScalar(const float* lambda, const uint32_t* nbr, uint32_t count,
+                            const PairCache& in, float lambdaI, const KernelConstants& k) {
+	DeltaSums out{};
+	for (uint32_t n = 0; n < count; n++) {
+		float t = in.w[n] * k.invRefPoly6;
+		t = t * t;
+		const float coef = lambdaI + lambda[nbr[n]] + k.scorrK * t * t;
+		out.x += coef * in.gx[n];
+		out.y += coef * in.gy[n];
+		out.z += coef * in.gz[n];
+	}
+	return out;
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef FLUID_SIMD_X86
+	#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return SimdLevel::Scalar;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	if (!osxsave) return SimdLevel::Scalar;
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512f = (info[1] & (1 << 16)) != 0;
+	if (avx512f && (xcr0 & 0xe6) == 0xe6) return SimdLevel::AVX512;
+	if (avx2 && fma && (xcr0 & 0x6) == 0x6) return SimdLevel::AVX2;
+	#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return SimdLevel::AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+	#endif
+#endif
+	return SimdLevel::Scalar;
+}
+
+const char* simdLevelName(SimdLevel level) {
+	switch (level) {
+		case SimdLevel::AVX512: return "AVX-512";
+		case SimdLevel::AVX2:   return "AVX2";
+		default:                return "Scalar";
+	}
+}
+
+const KernelDispatch& selectKernels(SimdLevel maxLevel) {
+	static const KernelDispatch scalar{SimdLevel::Scalar, lambdaScalar, deltaScalar, lambdaCachedScalar, deltaCachedScalar};
+#ifdef FLUID_SIMD_X86
+	static const KernelDispatch avx2{SimdLevel::AVX2, lambdaAVX2, deltaAVX2, lambdaCachedAVX2, deltaCachedAVX2};
+	static const KernelDispatch avx512{SimdLevel::AVX512, lambdaAVX512, deltaAVX512, lambdaCachedAVX512,
+	                                   deltaCachedAVX512};
+	static const SimdLevel supported = detectSimdLevel();
+	const SimdLevel level = static_cast<int>(maxLevel) < static_cast<int>(supported) ? maxLevel : supported;
+	if (level == SimdLevel::AVX512) return avx512;
+	if (level == SimdLevel::AVX2) return avx2;
+#endif
+	return scalar;
+}
+
+} // namespace sph
@@ -0,0 +1,89 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_SPHKERNELSSIMD_H
+#define LEARNOPENGL_SPHKERNELSSIMD_H
+
+#include <cstdint>
+
+/*
+ * 批量 SPH 核函数：一次处理粒子 i 的一段邻居，供 lambda / 位置增量两个循环使用
+ *  AVX2 一次 8 个邻居，AVX-512 一次 16 个邻居，尾部用掩码处理
+ *  运行时检测 CPU 支持的指令集，不支持时回退到标量实现
+ *
+ * 核函数统一写成：
+ *  W(r)  = poly6Coeff * (h^2 - r^2)^3                 , 0 < r < cutoff
+ *  ∇W(s) = spikyCoeff * (h - r)^2 / r * s             , 0 < r < cutoff
+ *
+ * 邻居对缓存：lambdaCached 在求和的同时把每个邻居的 W 与 ∇W 写入与邻居表对齐的缓存，
+ * 同一次迭代的 deltaCached 直接读取，不再计算距离与核函数（与核函数无关）
+ */
+namespace sph {
+
+struct KernelConstants {
+	float h;           // 核半径
+	float h2;          // h^2
+	float cutoff2;     // 邻居截断半径的平方（不超过 h^2），邻居表中更远的粒子不参与计算
+	float poly6Coeff;  // poly6 的整体系数
+	float spikyCoeff;  // spiky 梯度的整体系数
+	float scorrK;      // 人工压力项 scorr = scorrK * (W / W(Δq))^4
+	float invRefPoly6; // 1 / W(Δq)
+};
+
+// lambda 循环需要的邻居求和结果
+struct LambdaSums {
+	float density;             // Σ W
+	float gradX, gradY, gradZ; // Σ ∇W
+	float sumSqrGrad;          // Σ |∇W|^2
+};
+
+struct DeltaSums {
+	float x, y, z; // Σ (λi + λj + scorr) ∇W
+};
+
+struct ParticleArrays {
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* lambda;
+};
+
+// 邻居对缓存（SoA），第 n 项对应邻居表中粒子 i 的第 n 个邻居；超出截断半径的邻居存 0
+struct PairCache {
+	float* w;
+	float* gx;
+	float* gy;
+	float* gz;
+};
+
+using LambdaBatchFn = LambdaSums (*)(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                     float xi, float yi, float zi, const KernelConstants& k);
+using DeltaBatchFn = DeltaSums (*)(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                   float xi, float yi, float zi, float lambdaI, const KernelConstants& k);
+using LambdaCachedFn = LambdaSums (*)(const ParticleArrays& p, const uint32_t* nbr, uint32_t count,
+                                      float xi, float yi, float zi, const KernelConstants& k, const PairCache& out);
+using DeltaCachedFn = DeltaSums (*)(const float* lambda, const uint32_t* nbr, uint32_t count,
+                                    const PairCache& in, float lambdaI, const KernelConstants& k);
+
+enum class SimdLevel { Scalar = 0, AVX2 = 1, AVX512 = 2 };
+
+struct KernelDispatch {
+	SimdLevel level;
+	LambdaBatchFn lambda;
+	DeltaBatchFn delta;
+	LambdaCachedFn lambdaCached;
+	DeltaCachedFn deltaCached;
+};
+
+SimdLevel detectSimdLevel(); // 当前 CPU 支持的最高级别
+const char* simdLevelName(SimdLevel level);
+// 返回不超过 maxLevel 且 CPU 支持的最高级别实现
+const KernelDispatch& selectKernels(SimdLevel maxLevel = SimdLevel::AVX512);
+// 由缓存求位置增量的标量实现，供没有 SIMD 版本的核函数使用
+DeltaSums deltaCachedScalar(const float* lambda, const uint32_t* nbr, uint32_t count,
+                            const PairCache& in, float lambdaI, const KernelConstants& k);
+
+} // namespace sph
+
+#endif //LEARNOPENGL_SPHKERNELSSIMD_H
@@ -0,0 +1,115 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "Checkpoint.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "Utils/log.cpp"
+
+namespace checkpoint {
+
+namespace {
+
+std::size_t alignUp(std::size_t v) {
+	return (v + kBlockAlignment - 1) / kBlockAlignment * kBlockAlignment;
+}
+
+} // namespace
+
+void Writer::addBlock(BlockId id, const void* data, uint32_t elementBytes, uint64_t count) {
+	m_blocks.push_back({{static_cast<uint32_t>(id), elementBytes, count, 0}, data});
+}
+
+bool Writer::write(const std::string& path) {
+	m_header.blockCount = static_cast<uint32_t>(m_blocks.size());
+	// 先确定每个块的偏移，块目录紧跟在头部后面
+	std::size_t offset = alignUp(sizeof(FileHeader) + m_blocks.size() * sizeof(BlockEntry));
+	for (auto& b : m_blocks) {
+		b.entry.offset = offset;
+		offset = alignUp(offset + b.entry.elementBytes * b.entry.count);
+	}
+
+	const std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!out) {
+			LOG_ERROR << "checkpoint: cannot open " << tmpPath;
+			return false;
+		}
+		static constexpr char zeros[kBlockAlignment] = {};
+		auto pad = [&] {
+			const auto pos = static_cast<std::size_t>(out.tellp());
+			out.write(zeros, static_cast<std::streamsize>(alignUp(pos) - pos));
+		};
+		out.write(reinterpret_cast<const char*>(&m_header), sizeof(FileHeader));
+		for (const auto& b : m_blocks) {
+			out.write(reinterpret_cast<const char*>(&b.entry), sizeof(BlockEntry));
+		}
+		for (const auto& b : m_blocks) {
+			pad();
+			out.write(static_cast<const char*>(b.data), static_cast<std::streamsize>(b.entry.elementBytes * b.entry.count));
+		}
+		pad();
+		if (!out) {
+			LOG_ERROR << "checkpoint: failed to write " << tmpPath;
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+	if (ec) {
+		LOG_ERROR << "checkpoint: cannot rename " << tmpPath << " to " << path << ": " << ec.message();
+		return false;
+	}
+	return true;
+}
+
+bool Reader::open(const std::string& path) {
+	if (!m_file.open(path)) {
+		LOG_ERROR << "checkpoint: cannot map " << path;
+		return false;
+	}
+	if (m_file.size() < sizeof(FileHeader)) {
+		LOG_ERROR << "checkpoint: " << path << " is too small";
+		return false;
+	}
+	std::memcpy(&m_header, m_file.data(), sizeof(FileHeader));
+	if (m_header.magic != kMagic) {
+		LOG_ERROR << "checkpoint: " << path << " is not a checkpoint file";
+		return false;
+	}
+	if (m_header.version > kVersion || m_header.headerBytes != sizeof(FileHeader)) {
+		LOG_ERROR << "checkpoint: unsupported version " << m_header.version << " in " << path;
+		return false;
+	}
+	const std::size_t directoryEnd = sizeof(FileHeader) + m_header.blockCount * sizeof(BlockEntry);
+	if (m_file.size() < directoryEnd) {
+		LOG_ERROR << "checkpoint: " << path << " is truncated";
+		return false;
+	}
+	m_entries = reinterpret_cast<const BlockEntry*>(m_file.data() + sizeof(FileHeader));
+	for (uint32_t i = 0; i < m_header.blockCount; i++) {
+		const BlockEntry& e = m_entries[i];
+		if (e.offset % kBlockAlignment != 0 || e.offset + e.elementBytes * e.count > m_file.size()) {
+			LOG_ERROR << "checkpoint: block " << e.id << " is out of range in " << path;
+			return false;
+		}
+	}
+	return true;
+}
+
+const void* Reader::block(BlockId id, uint32_t elementBytes) const {
+	for (uint32_t i = 0; i < m_header.blockCount; i++) {
+		const BlockEntry& e = m_entries[i];
+		if (e.id != id) continue;
+		if (e.elementBytes != elementBytes || e.count != m_header.particleCount) return nullptr;
+		return m_file.data() + e.offset;
+	}
+	return nullptr;
+}
+
+} // namespace checkpoint
@@ -0,0 +1,124 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_CHECKPOINT_H
+#define LEARNOPENGL_CHECKPOINT_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utils/MappedFile.h"
+
+/*
+ * 流体模拟的二进制快照（checkpoint）格式，CPU 与 GPU 求解器共用
+ *  文件布局（小端）：
+ *   FileHeader（128 字节）        魔数、版本、粒子数、步数与模拟参数
+ *   BlockEntry[blockCount]        块目录：块编号、元素大小、元素个数、文件内偏移
+ *   数据块                        每块按 64 字节对齐，连续存放一个属性数组
+ *  读取时整体映射文件，数据块可以直接 memcpy 到粒子数组或用 glBufferSubData 上传，不逐个粒子解析
+ *  新增字段只能追加在块目录中（新的块编号），旧版本读取时忽略不认识的块
+ */
+namespace checkpoint {
+
+static_assert(std::endian::native == std::endian::little, "checkpoint 格式按小端存储，大端平台需要先做字节交换");
+
+constexpr uint32_t kMagic = 0x43464250u; // "PBFC"
+constexpr uint32_t kVersion = 1;
+constexpr std::size_t kBlockAlignment = 64;
+
+enum Solver : uint32_t {
+	kSolverCPU = 0,
+	kSolverGPU = 1,
+};
+
+// 块编号，写入文件后不能修改
+enum BlockId : uint32_t {
+	kBlockPosX = 1, kBlockPosY, kBlockPosZ,
+	kBlockVelX, kBlockVelY, kBlockVelZ,
+	kBlockOldX, kBlockOldY, kBlockOldZ,
+	kBlockLambda,
+	kBlockDensity,
+	kBlockId,               // uint32，粒子原始编号
+	kBlockVorticity,        // 上一步的 |ω|，下一步涡量约束求 ∇|ω| 时读取
+	// GPU 求解器的四个粒子缓冲（gpustream，每项 16 字节，与缓冲布局相同），加载时直接上传
+	kBlockGpuPosLambda = 64,
+	kBlockGpuVelocity,
+	kBlockGpuOldPos,
+	kBlockGpuAux,
+};
+
+struct FileHeader {
+	uint32_t magic = kMagic;
+	uint32_t version = kVersion;
+	uint32_t headerBytes = sizeof(FileHeader);
+	uint32_t blockCount = 0;
+	uint64_t particleCount = 0;
+	uint64_t stepCount = 0;
+	uint32_t solver = kSolverCPU;
+	uint32_t seed = 0;
+	uint32_t pbfNumIters = 0;
+	float dt = 0.0f;
+	float h = 0.0f;
+	float mass = 0.0f;
+	float rho = 0.0f;
+	float lambdaEpsilon = 0.0f;
+	float neighbourRadius = 0.0f;
+	float cellSize = 0.0f;
+	float boundaryMin[3] = {};
+	float boundaryMax[3] = {};
+	uint32_t reserved[8] = {}; // 预留，保持头部为 128 字节
+};
+static_assert(sizeof(FileHeader) == 128);
+
+struct BlockEntry {
+	uint32_t id = 0;
+	uint32_t elementBytes = 0;
+	uint64_t count = 0;
+	uint64_t offset = 0; // 相对文件起始
+};
+static_assert(sizeof(BlockEntry) == 24);
+
+// 收集要写入的数组（只保存指针，不拷贝），write 时一次性写出
+class Writer {
+public:
+	explicit Writer(const FileHeader& header) : m_header(header) {}
+	void addBlock(BlockId id, const void* data, uint32_t elementBytes, uint64_t count);
+	// 先写入 path.tmp 再重命名，写到一半中断时不会破坏已有的快照
+	bool write(const std::string& path);
+
+private:
+	struct Pending {
+		BlockEntry entry;
+		const void* data;
+	};
+	FileHeader m_header;
+	std::vector<Pending> m_blocks;
+};
+
+// 映射快照文件并校验头部与块目录
+class Reader {
+public:
+	bool open(const std::string& path);
+	[[nodiscard]] const FileHeader& header() const { return m_header; }
+	/*
+	 * @brief: 查找数据块
+	 * @return: 块数据的起始地址；块不存在、元素大小或个数与 particleCount 不符时返回 nullptr
+	 */
+	[[nodiscard]] const void* block(BlockId id, uint32_t elementBytes) const;
+	template<class T> [[nodiscard]] const T* block(BlockId id) const {
+		return static_cast<const T*>(block(id, sizeof(T)));
+	}
+
+private:
+	MappedFile m_file;
+	FileHeader m_header;
+	const BlockEntry* m_entries = nullptr;
+};
+
+} // namespace checkpoint
+
+#endif //LEARNOPENGL_CHECKPOINT_H
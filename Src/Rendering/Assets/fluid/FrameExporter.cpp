@@ -0,0 +1,254 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "FrameExporter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "PackedParticles.h"
+#include "Utils/RansCoder.h"
+#include "Utils/log.cpp"
+
+void ExportFrame::resize(std::size_t n, bool withId) {
+	for (auto* a : {&x, &y, &z, &vx, &vy, &vz, &density}) {
+		a->resize(n);
+	}
+	id.resize(withId ? n : 0);
+}
+
+namespace {
+
+// 每个通道的量化区间：value = lo + q * step；量化由 packed::quantise16（SIMD）完成，与紧凑粒子格式的舍入一致
+struct Quantiser {
+	float lo = 0.0f, hi = 0.0f, step = 0.0f;
+
+	Quantiser(float lo, float hi) : lo(lo), hi(hi) { step = std::max(hi - lo, 1e-6f) / 65535.0f; }
+	void quantise(const float* src, std::size_t n, uint16_t* dst) const { packed::quantise16(src, n, lo, hi, dst); }
+	[[nodiscard]] float dequantise(uint16_t q) const { return lo + static_cast<float>(q) * step; }
+};
+
+// 不小于 max|v| 的 2 的幂，区间在相邻帧之间通常不变，差分编码更有效
+float symmetricRange(const std::vector<float>& a, const std::vector<float>* b = nullptr, const std::vector<float>* c = nullptr) {
+	float m = 0.0f;
+	for (const auto* v : {&a, b, c}) {
+		if (!v) continue;
+		for (float f : *v) m = std::max(m, std::fabs(f));
+	}
+	if (!(m > 0.0f) || !std::isfinite(m)) return 1.0f;
+	int e = 0;
+	std::frexp(m, &e); // m = f * 2^e，f ∈ [0.5, 1)
+	return std::ldexp(1.0f, e);
+}
+
+std::array<Quantiser, frameseq::kChannels> makeQuantisers(const frameseq::SequenceHeader& header, float velocityRange,
+                                                          float densityRange) {
+	return {Quantiser(header.aabbMin[0], header.aabbMax[0]), Quantiser(header.aabbMin[1], header.aabbMax[1]),
+	        Quantiser(header.aabbMin[2], header.aabbMax[2]), Quantiser(-velocityRange, velocityRange),
+	        Quantiser(-velocityRange, velocityRange),        Quantiser(-velocityRange, velocityRange),
+	        Quantiser(-densityRange, densityRange)};
+}
+
+} // namespace
+
+// ----------- FrameExporter -----------
+FrameExporter::~FrameExporter() {
+	close();
+}
+
+bool FrameExporter::open(const std::string& path, const Eigen::Vector3f& aabbMin, const Eigen::Vector3f& aabbMax,
+                         int interval, std::size_t queueCapacity, int keyframeInterval) {
+	close();
+	m_out.open(path, std::ios::binary | std::ios::trunc);
+	if (!m_out) {
+		LOG_ERROR << "FrameExporter: cannot open " << path;
+		return false;
+	}
+	m_header = {};
+	m_header.keyframeInterval = static_cast<uint32_t>(std::max(keyframeInterval, 1));
+	for (int a = 0; a < 3; a++) {
+		m_header.aabbMin[a] = aabbMin[a];
+		m_header.aabbMax[a] = aabbMax[a];
+	}
+	m_out.write(reinterpret_cast<const char*>(&m_header), sizeof(m_header));
+	m_interval = std::max(interval, 1);
+	m_requests = 0;
+	m_frameIndex = 0;
+	m_written = m_dropped = 0;
+	m_bytes = sizeof(m_header);
+	m_stop = false;
+	m_queue.clear();
+	m_free.clear();
+	for (std::size_t i = 0; i < std::max<std::size_t>(queueCapacity, 1); i++) {
+		m_free.push_back(std::make_unique<ExportFrame>());
+	}
+	m_writer = std::thread(&FrameExporter::writerLoop, this);
+	return true;
+}
+
+void FrameExporter::close() {
+	if (!m_writer.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_one();
+	m_writer.join();
+	m_out.close();
+	LOG_INFO << "FrameExporter: wrote " << m_written << " frames (" << m_bytes << " bytes), dropped " << m_dropped;
+}
+
+bool FrameExporter::shouldCapture() {
+	return isOpen() && m_requests++ % m_interval == 0;
+}
+
+std::unique_ptr<ExportFrame> FrameExporter::acquireFrame() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_free.empty()) {
+		m_dropped++; // 后台线程跟不上，丢掉这一帧而不是阻塞求解器
+		return nullptr;
+	}
+	auto frame = std::move(m_free.back());
+	m_free.pop_back();
+	return frame;
+}
+
+void FrameExporter::submit(std::unique_ptr<ExportFrame> frame) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(std::move(frame));
+	}
+	m_cv.notify_one();
+}
+
+void FrameExporter::cancelFrame(std::unique_ptr<ExportFrame> frame) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free.push_back(std::move(frame));
+	m_dropped++;
+}
+
+void FrameExporter::writerLoop() {
+	for (;;) {
+		std::unique_ptr<ExportFrame> frame;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+			if (m_queue.empty()) return; // 已停止且队列为空
+			frame = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+		encode(*frame);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_free.push_back(std::move(frame));
+	}
+}
+
+void FrameExporter::encode(const ExportFrame& frame) {
+	const std::size_t n = frame.size();
+	frameseq::FrameHeader fh;
+	fh.step = frame.step;
+	fh.particleCount = static_cast<uint32_t>(n);
+	fh.velocityRange = symmetricRange(frame.vx, &frame.vy, &frame.vz);
+	fh.densityRange = symmetricRange(frame.density);
+	// 粒子数变化时无法做差分，强制关键帧
+	const bool keyframe = m_frameIndex % m_header.keyframeInterval == 0 || m_previous[0].size() != n;
+	fh.flags = keyframe ? frameseq::kKeyframe : 0u;
+
+	const auto quantisers = makeQuantisers(m_header, fh.velocityRange, fh.densityRange);
+	const std::vector<float>* channels[frameseq::kChannels] = {&frame.x,  &frame.y,  &frame.z,      &frame.vx,
+	                                                           &frame.vy, &frame.vz, &frame.density};
+	m_payload.clear();
+	m_quantised.resize(n);
+	m_low.resize(n);
+	m_high.resize(n);
+	for (int c = 0; c < frameseq::kChannels; c++) {
+		const float* src = channels[c]->data();
+		const Quantiser& q = quantisers[c];
+		// 按粒子编号存放，CPU 求解器重排粒子内存后差分仍然对应同一个粒子
+		if (frame.id.empty()) {
+			q.quantise(src, n, m_quantised.data());
+		} else {
+			m_scattered.resize(n);
+			q.quantise(src, n, m_scattered.data());
+			for (std::size_t i = 0; i < n; i++) m_quantised[frame.id[i]] = m_scattered[i];
+		}
+		std::vector<uint16_t>& previous = m_previous[c];
+		previous.resize(n);
+		for (std::size_t i = 0; i < n; i++) {
+			const auto r = static_cast<uint16_t>(keyframe ? m_quantised[i] : m_quantised[i] - previous[i]);
+			const auto zig = static_cast<uint16_t>((r << 1) ^ static_cast<uint16_t>(static_cast<int16_t>(r) >> 15));
+			m_low[i] = static_cast<uint8_t>(zig);
+			m_high[i] = static_cast<uint8_t>(zig >> 8);
+		}
+		previous.swap(m_quantised);
+		m_quantised.resize(n);
+		for (const auto* plane : {&m_low, &m_high}) {
+			const std::size_t lengthPos = m_payload.size();
+			m_payload.resize(lengthPos + sizeof(uint32_t));
+			rans::encode(plane->data(), n, m_payload);
+			const auto length = static_cast<uint32_t>(m_payload.size() - lengthPos - sizeof(uint32_t));
+			std::memcpy(m_payload.data() + lengthPos, &length, sizeof(length));
+		}
+	}
+	fh.payloadBytes = static_cast<uint32_t>(m_payload.size());
+	m_out.write(reinterpret_cast<const char*>(&fh), sizeof(fh));
+	m_out.write(reinterpret_cast<const char*>(m_payload.data()), static_cast<std::streamsize>(m_payload.size()));
+	m_frameIndex++;
+	m_written++;
+	m_bytes += sizeof(fh) + m_payload.size();
+}
+
+// ----------- FrameSequenceReader -----------
+bool FrameSequenceReader::open(const std::string& path) {
+	m_in.open(path, std::ios::binary);
+	if (!m_in.read(reinterpret_cast<char*>(&m_header), sizeof(m_header)) || m_header.magic != frameseq::kMagic ||
+	    m_header.version > frameseq::kVersion || m_header.channels != frameseq::kChannels) {
+		LOG_ERROR << "FrameSequenceReader: " << path << " is not a frame sequence";
+		return false;
+	}
+	return true;
+}
+
+bool FrameSequenceReader::next(ExportFrame& frame) {
+	frameseq::FrameHeader fh;
+	if (!m_in.read(reinterpret_cast<char*>(&fh), sizeof(fh)) || fh.magic != frameseq::kFrameMagic) return false;
+	m_payload.resize(fh.payloadBytes);
+	if (!m_in.read(reinterpret_cast<char*>(m_payload.data()), fh.payloadBytes)) return false;
+	const std::size_t n = fh.particleCount;
+	const bool keyframe = fh.flags & frameseq::kKeyframe;
+	if (!keyframe && m_previous[0].size() != n) return false; // 没有从关键帧开始读
+
+	frame.step = fh.step;
+	frame.resize(n, false);
+	const auto quantisers = makeQuantisers(m_header, fh.velocityRange, fh.densityRange);
+	std::vector<float>* channels[frameseq::kChannels] = {&frame.x,  &frame.y,  &frame.z,      &frame.vx,
+	                                                     &frame.vy, &frame.vz, &frame.density};
+	m_low.resize(n);
+	m_high.resize(n);
+	std::size_t pos = 0;
+	for (int c = 0; c < frameseq::kChannels; c++) {
+		for (auto* plane : {&m_low, &m_high}) {
+			uint32_t length = 0;
+			if (pos + sizeof(length) > m_payload.size()) return false;
+			std::memcpy(&length, m_payload.data() + pos, sizeof(length));
+			pos += sizeof(length);
+			if (pos + length > m_payload.size() || !rans::decode(m_payload.data() + pos, length, plane->data(), n)) {
+				return false;
+			}
+			pos += length;
+		}
+		std::vector<uint16_t>& previous = m_previous[c];
+		previous.resize(n);
+		float* dst = channels[c]->data();
+		for (std::size_t i = 0; i < n; i++) {
+			const auto zig = static_cast<uint16_t>(m_low[i] | m_high[i] << 8);
+			const auto r = static_cast<uint16_t>((zig >> 1) ^ static_cast<uint16_t>(-(zig & 1)));
+			previous[i] = static_cast<uint16_t>(keyframe ? r : previous[i] + r);
+			dst[i] = quantisers[c].dequantise(previous[i]);
+		}
+	}
+	return true;
+}
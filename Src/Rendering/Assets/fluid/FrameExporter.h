@@ -0,0 +1,150 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_FRAMEEXPORTER_H
+#define LEARNOPENGL_FRAMEEXPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __unix__
+	#include <eigen3/Eigen/Eigen>
+#elif _WIN32
+	#include <Eigen/Eigen>
+#endif
+
+/*
+ * 粒子轨迹导出（帧序列文件），供离线后处理使用，CPU 与 GPU 求解器共用
+ *  每帧保存位置、速度与密度，每个通道量化为 16 位：
+ *   位置按场景包围盒量化；速度与密度按本帧最大绝对值向上取 2 的幂得到的对称区间量化（区间写在帧头中）
+ *  非关键帧保存与上一帧量化值的差（按粒子编号对应），zigzag 后拆成低 / 高字节两个平面，各自用 rANS 熵编码
+ *  每 keyframeInterval 帧一个关键帧，保存量化值本身，可以从关键帧开始解码
+ *
+ * 文件布局（小端）：
+ *  SequenceHeader
+ *  每帧：FrameHeader | 14 个流（7 个通道 * 2 个字节平面），每个流为 uint32 长度 + rANS 流
+ *
+ * 线程模型：
+ *  求解器线程调用 shouldCapture / acquireFrame / submit，编码与写盘在后台线程进行
+ *  帧缓冲数量固定为 queueCapacity，全部在排队时 acquireFrame 返回 nullptr，求解器跳过这一帧，不会等待磁盘
+ */
+struct ExportFrame {
+	uint64_t step = 0;
+	std::vector<float> x, y, z;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> density;
+	std::vector<uint32_t> id; // 粒子原始编号；为空表示第 i 个粒子的编号就是 i
+
+	void resize(std::size_t n, bool withId);
+	[[nodiscard]] std::size_t size() const { return x.size(); }
+};
+
+namespace frameseq {
+
+constexpr uint32_t kMagic = 0x53464250u;      // "PBFS"
+constexpr uint32_t kFrameMagic = 0x454d5246u; // "FRME"
+constexpr uint32_t kVersion = 1;
+constexpr int kChannels = 7; // x, y, z, vx, vy, vz, density
+
+struct SequenceHeader {
+	uint32_t magic = kMagic;
+	uint32_t version = kVersion;
+	uint32_t channels = kChannels;
+	uint32_t keyframeInterval = 0;
+	float aabbMin[3] = {};
+	float aabbMax[3] = {};
+};
+static_assert(sizeof(SequenceHeader) == 40);
+
+struct FrameHeader {
+	uint32_t magic = kFrameMagic;
+	uint32_t flags = 0; // kKeyframe
+	uint64_t step = 0;
+	uint32_t particleCount = 0;
+	float velocityRange = 0.0f; // 速度量化区间 [-range, range]
+	float densityRange = 0.0f;  // 密度量化区间 [-range, range]
+	uint32_t payloadBytes = 0;  // 帧头之后的字节数
+};
+static_assert(sizeof(FrameHeader) == 32);
+
+constexpr uint32_t kKeyframe = 1u;
+
+} // namespace frameseq
+
+class FrameExporter {
+public:
+	FrameExporter() = default;
+	~FrameExporter();
+	FrameExporter(const FrameExporter&) = delete;
+	FrameExporter& operator=(const FrameExporter&) = delete;
+
+	/*
+	 * @param aabbMin, aabbMax: 位置的量化范围，一般取模拟边界
+	 * @param interval: 每 interval 次 shouldCapture 导出一帧
+	 * @param queueCapacity: 最多同时排队的帧数（也是帧缓冲的数量）
+	 * @param keyframeInterval: 关键帧间隔
+	 */
+	bool open(const std::string& path, const Eigen::Vector3f& aabbMin, const Eigen::Vector3f& aabbMax,
+	          int interval = 1, std::size_t queueCapacity = 4, int keyframeInterval = 32);
+	void close(); // 写完排队中的帧后关闭文件
+	[[nodiscard]] bool isOpen() const { return m_writer.joinable(); }
+
+	bool shouldCapture();                        // 每个模拟帧调用一次，返回这一帧是否需要导出
+	std::unique_ptr<ExportFrame> acquireFrame(); // 取一个空闲的帧缓冲，没有空闲缓冲时返回 nullptr
+	void submit(std::unique_ptr<ExportFrame> frame);
+	void cancelFrame(std::unique_ptr<ExportFrame> frame); // 归还未提交的帧缓冲（计入 droppedFrames）
+	void skipFrame() { m_dropped++; } // 调用方因为其他原因放弃了一帧（计入 droppedFrames）
+
+	[[nodiscard]] uint64_t writtenFrames() const { return m_written; }
+	[[nodiscard]] uint64_t droppedFrames() const { return m_dropped; }
+	[[nodiscard]] uint64_t writtenBytes() const { return m_bytes; }
+
+private:
+	void writerLoop();
+	void encode(const ExportFrame& frame);
+
+	std::ofstream m_out;
+	frameseq::SequenceHeader m_header;
+	int m_interval = 1;
+	uint64_t m_requests = 0;
+
+	std::thread m_writer;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::unique_ptr<ExportFrame>> m_queue; // 等待编码的帧
+	std::vector<std::unique_ptr<ExportFrame>> m_free; // 空闲的帧缓冲
+	bool m_stop = false;
+	std::atomic<uint64_t> m_written{0}, m_dropped{0}, m_bytes{0};
+
+	// 以下只在后台线程中使用
+	uint64_t m_frameIndex = 0;
+	std::vector<uint16_t> m_previous[frameseq::kChannels]; // 上一帧的量化值（按粒子编号）
+	std::vector<uint16_t> m_quantised, m_scattered; // m_scattered：粒子按内存顺序的量化值，再按编号写入 m_quantised
+	std::vector<uint8_t> m_low, m_high, m_payload;
+};
+
+// 顺序读取帧序列文件，用于离线后处理
+class FrameSequenceReader {
+public:
+	bool open(const std::string& path);
+	// 读取下一帧（按粒子编号顺序，id 为空），文件结束或格式错误时返回 false
+	bool next(ExportFrame& frame);
+	[[nodiscard]] const frameseq::SequenceHeader& header() const { return m_header; }
+
+private:
+	std::ifstream m_in;
+	frameseq::SequenceHeader m_header;
+	std::vector<uint16_t> m_previous[frameseq::kChannels];
+	std::vector<uint8_t> m_payload, m_low, m_high;
+};
+
+#endif //LEARNOPENGL_FRAMEEXPORTER_H
@@ -91,24 +91,33 @@ bool GPU_FluidRender::ensureInitialized() {
 
 	// Setup VAO
 	glGenVertexArrays(1, &m_vao);
+	bindParticleBuffers(*sim);
+
+	LOG_INFO << "[GPU_FluidRender] Initialized GL resources: program=" << m_renderProgram << ", vao=" << m_vao << ", particles=" << m_numParticles;
+	return true;
+}
+
+void GPU_FluidRender::bindParticleBuffers(const GPU_FluidSimulator& sim) {
 	glBindVertexArray(m_vao);
 
-	// Bind the SSBO as array buffer to use as vertex source
-	glBindBuffer(GL_ARRAY_BUFFER, particleSSBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GPU_Particle), (void*)0);
+	// Bind the SSBOs as array buffers to use as vertex source; every stream has a 16-byte stride
+	constexpr auto stride = static_cast<GLsizei>(gpustream::kStride);
+	// position (xyz of posLambda, w is λ)
+	glBindBuffer(GL_ARRAY_BUFFER, sim.getParticleSSBO(gpustream::PosLambda));
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GPU_Particle), (void*)(offsetof(GPU_Particle, vel)));
+	glBindBuffer(GL_ARRAY_BUFFER, sim.getParticleSSBO(gpustream::Velocity));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
 	glEnableVertexAttribArray(1);
 	// density
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(GPU_Particle), (void*)(offsetof(GPU_Particle, density)));
+	glBindBuffer(GL_ARRAY_BUFFER, sim.getParticleSSBO(gpustream::Aux));
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(GPU_ParticleAux, density)));
 	glEnableVertexAttribArray(2);
 
 	// Unbind
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	LOG_INFO << "[GPU_FluidRender] Initialized GL resources: program=" << m_renderProgram << ", vao=" << m_vao << ", particles=" << m_numParticles;
-	return true;
+	m_boundSSBO = sim.getParticleSSBO(gpustream::PosLambda);
 }
 
 void GPU_FluidRender::Update(float deltaTime) {
@@ -141,6 +150,11 @@ void GPU_FluidRender::Update(float deltaTime) {
 		return; // don't proceed to draw
 	}
 
+	// 粒子数可能因为加载快照而改变；开启网格重排时当前的粒子缓冲每次重排都会交换
+	if (auto sim = getEntity()->getComponent<GPU_FluidSimulator>()) {
+		m_numParticles = sim->getParams().numParticles;
+		if (sim->getParticleSSBO() != m_boundSSBO) bindParticleBuffers(*sim);
+	}
 	glBindVertexArray(m_vao);
 	glDrawArrays(GL_POINTS, 0, m_numParticles);
 	glBindVertexArray(0);
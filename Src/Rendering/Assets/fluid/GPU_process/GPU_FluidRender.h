@@ -13,11 +13,14 @@
 #include "ECS/Components/Component.h"
 #include "Shader/Shader.h"
 
+class GPU_FluidSimulator;
+
 class GPU_FluidRender : public Component{
 private:
 	GLuint m_renderProgram = 0;
 	GLuint m_vao = 0;
 	GLuint m_vbo = 0;
+	GLuint m_boundSSBO = 0; // VAO 当前引用的位置缓冲，求解器重排粒子后四个缓冲都会换成另一组
 	int m_numParticles = 0;
 
 	Shader m_shader;
@@ -35,6 +38,8 @@ private:
 	GLuint createShaderProgram(const std::string& vertPath, const std::string& fragPath);
 	// Ensure GL resources (shader/VAO) are created. Returns true if initialized.
 	bool ensureInitialized();
+	// 把求解器的粒子缓冲设置为 VAO 的顶点来源（位置、速度、密度各来自一个缓冲）
+	void bindParticleBuffers(const GPU_FluidSimulator& sim);
 };
 
 
@@ -2,10 +2,35 @@
 // Created by Jingren Bai on 25-11-12.
 //
 
-#include <random>
 #include "GPU_FluidSimulator.h"
+
+#include <algorithm>
+#include <bit>
+#include <numbers>
+#include "Rendering/Assets/fluid/Checkpoint.h"
+#include "Rendering/Assets/fluid/FrameExporter.h"
+#include "Rendering/Assets/fluid/PackedParticles.h"
+
+#include "Utils/CounterRNG.h"
 #include "Utils/getProgramPath.h"
 
+namespace {
+
+// 编号全为 0（新生成的粒子）时按下标补上
+void assignMissingIds(std::vector<GPU_Particle>& particles) {
+	if (particles.size() < 2 || particles[0].id != 0 || particles[1].id != 0) return;
+	for (std::size_t i = 0; i < particles.size(); i++) particles[i].id = static_cast<uint32_t>(i);
+}
+
+// 四个粒子缓冲的绑定点（fluidCommon.glsl）与网格重排时写入的绑定点（csReorderParticles.comp）
+constexpr GLuint kParticleBinding[gpustream::Count] = {1, 12, 13, 14};
+constexpr GLuint kSortedBinding[gpustream::Count] = {11, 15, 16, 17};
+// 四个粒子缓冲在快照中的块编号
+constexpr checkpoint::BlockId kStreamBlock[gpustream::Count] = {
+	checkpoint::kBlockGpuPosLambda, checkpoint::kBlockGpuVelocity, checkpoint::kBlockGpuOldPos, checkpoint::kBlockGpuAux};
+
+} // namespace
+
 GLuint GPU_FluidSimulator::createComputeShaderProgram(const std::string& file)
 {
 	std::string path = getProgramPath() + "/shaders/" + file;
@@ -52,12 +77,24 @@ GPU_FluidSimulator::GPU_FluidSimulator(int numParticles)
 	  computeLambdaProgram(0),
 	  computeDeltaProgram(0),
 	  epilogueProgram(0),
-	  particleSSBO(0),
+	  viscosityVorticityProgram(0),
+	  gridStatsProgram(0),
+	  particleStatsProgram(0),
+	  packParticlesProgram(0),
+	  scanCellsProgram(0),
+	  scanBlockSumsProgram(0),
+	  scanAddProgram(0),
+	  scatterGridProgram(0),
+	  reorderProgram(0),
 	  cellIndexSSBO(0),
 	  cellCountSSBO(0),
-	  paramsUBO(0)
+	  paramsUBO(0),
+	  statsSSBO(0)
 {
 	params.numParticles = numParticles;
+	// 非空网格数不会超过粒子数，槽数取不小于粒子数的 2 的幂
+	params.cellTableSize = std::bit_ceil(static_cast<uint32_t>(std::max(numParticles, 1024)));
+	updateArtificialPressure();
 }
 GPU_FluidSimulator::~GPU_FluidSimulator() {
 	// 只有在 OpenGL 已初始化且 id 非 0 时才删除
@@ -66,20 +103,58 @@ GPU_FluidSimulator::~GPU_FluidSimulator() {
 	if (computeLambdaProgram)    glDeleteProgram(computeLambdaProgram);
 	if (computeDeltaProgram)     glDeleteProgram(computeDeltaProgram);
 	if (epilogueProgram)         glDeleteProgram(epilogueProgram);
+	if (viscosityVorticityProgram) glDeleteProgram(viscosityVorticityProgram);
+	if (gridStatsProgram)        glDeleteProgram(gridStatsProgram);
+	if (particleStatsProgram)    glDeleteProgram(particleStatsProgram);
+	if (packParticlesProgram)    glDeleteProgram(packParticlesProgram);
+	if (scanCellsProgram)        glDeleteProgram(scanCellsProgram);
+	if (scanBlockSumsProgram)    glDeleteProgram(scanBlockSumsProgram);
+	if (scanAddProgram)          glDeleteProgram(scanAddProgram);
+	if (scatterGridProgram)      glDeleteProgram(scatterGridProgram);
+	if (reorderProgram)          glDeleteProgram(reorderProgram);
+	if (buildCellTilesProgram)   glDeleteProgram(buildCellTilesProgram);
+	if (computeLambdaTiledProgram) glDeleteProgram(computeLambdaTiledProgram);
+	if (computeDeltaTiledProgram) glDeleteProgram(computeDeltaTiledProgram);
 
-	if (particleSSBO)            glDeleteBuffers(1, &particleSSBO);
+	glDeleteBuffers(gpustream::Count, particleSSBO); // 为 0 的名字会被忽略
+	glDeleteBuffers(gpustream::Count, particleBackSSBO);
 	if (cellIndexSSBO)           glDeleteBuffers(1, &cellIndexSSBO);
 	if (cellCountSSBO)           glDeleteBuffers(1, &cellCountSSBO);
+	if (cellStartSSBO)           glDeleteBuffers(1, &cellStartSSBO);
+	if (particleRankSSBO)        glDeleteBuffers(1, &particleRankSSBO);
+	if (scanBlockSSBO)           glDeleteBuffers(1, &scanBlockSSBO);
+	if (cellTileSSBO)            glDeleteBuffers(1, &cellTileSSBO);
 	if (paramsUBO)               glDeleteBuffers(1, &paramsUBO);
+	if (statsSSBO)               glDeleteBuffers(1, &statsSSBO);
+	if (pairCacheSSBO)           glDeleteBuffers(1, &pairCacheSSBO);
+	if (pairNeighbourSSBO)       glDeleteBuffers(1, &pairNeighbourSSBO);
+	if (packedSSBO)              glDeleteBuffers(1, &packedSSBO);
+	for (int k = 0; k < kStatsRing; k++) {
+		if (statsReadback[k])    glDeleteBuffers(1, &statsReadback[k]);
+		if (statsFence[k])       glDeleteSync(statsFence[k]);
+	}
+	if (readbackBuffer)          glDeleteBuffers(1, &readbackBuffer);
+	if (readbackFence)           glDeleteSync(readbackFence);
 
 }
 
 void GPU_FluidSimulator::onAttach() {
 	LOG_INFO << "GPU_FluidSimulator attached";
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<float> dis(-0.0015f, 0.0015f); // 创建一个随机数生成器, 范围在-0.25到0.25之间
+	// 初始位置抖动，范围在-0.0015到0.0015之间，由粒子编号与种子决定
+	auto jitter = [this](int i) {
+		const auto r = crng::uniform4(static_cast<uint32_t>(i), 0u, crng::kStreamInit, params.seed);
+		return (Eigen::Vector3f(r[0], r[1], r[2]) * 2.0f - Eigen::Vector3f::Ones()) * 0.0015f;
+	};
 	LOG_INFO << "FluidSimulator init";
+	if (initialLayout) {
+		const Eigen::Vector3f boundaryMin(params.boundaryMinX, params.boundaryMinY, params.boundaryMinZ);
+		const Eigen::Vector3f boundaryMax(params.boundaryMaxX, params.boundaryMaxY, params.boundaryMaxZ);
+		for (const Eigen::Vector3f& pos : scenario::generate(*initialLayout, params.numParticles, boundaryMin, boundaryMax, params.seed)) {
+			particlePos.emplace_back(pos);
+		}
+		LOG_INFO << "Init particle nums is " << params.numParticles << " (" << scenario::layoutName(*initialLayout) << "). Finished init.";
+		return;
+	}
 	Eigen::Vector3f initPos = Eigen::Vector3f(1.0f, 1.0f, 1.0f);
 	int renderType = 2; // 1: cubic, 2: dam break
 	if(renderType == 1) {
@@ -91,9 +166,9 @@ void GPU_FluidSimulator::onAttach() {
 			int floor = i / numPerFloor;
 			int row = (i % numPerFloor) / numPerRow;
 			int col = (i % numPerFloor) % numPerRow;
-			Eigen::Vector3f pos = Eigen::Vector3f(static_cast<float>(col) * spacing + dis(gen),
-												  static_cast<float>(floor) * spacing + dis(gen),
-												  static_cast<float>(row) * spacing + dis(gen)) + initPos;
+			Eigen::Vector3f pos = Eigen::Vector3f(static_cast<float>(col) * spacing,
+												  static_cast<float>(floor) * spacing,
+												  static_cast<float>(row) * spacing) + jitter(i) + initPos;
 			particlePos.emplace_back(pos);
 //		LOG_INFO << "particle " << i << " pos: " << particlePos[i].pos.transpose();
 		}
@@ -110,9 +185,9 @@ void GPU_FluidSimulator::onAttach() {
 			int floor = i / (numPerRow * numPerCol);
 			int row = (i % (numPerRow * numPerCol)) / numPerRow;
 			int col = (i % (numPerRow * numPerCol)) % numPerRow;
-			Eigen::Vector3f pos = Eigen::Vector3f(static_cast<float>(col) * spacing + dis(gen),
-												  static_cast<float>(floor) * spacing + dis(gen),
-												  static_cast<float>(row) * spacing + dis(gen)) + initPos;
+			Eigen::Vector3f pos = Eigen::Vector3f(static_cast<float>(col) * spacing,
+												  static_cast<float>(floor) * spacing,
+												  static_cast<float>(row) * spacing) + jitter(i) + initPos;
 			particlePos.emplace_back(pos);
 		}
 		LOG_INFO << "row: " << numPerRow << ", col: " << numPerRow << ", floor: " << numPerFloor;
@@ -122,36 +197,81 @@ void GPU_FluidSimulator::onAttach() {
 //	LOG_INFO << "row: " << numPerRow << ", col: " << numPerRow << ", floor: " << numPerFloor;
 //	LOG_INFO << "Init particle nums is " << params.numParticles << ". " << "Finished init.";
 }
+void GPU_FluidSimulator::setScenario(scenario::Layout layout) {
+	initialLayout = layout;
+}
+void GPU_FluidSimulator::setXSPHViscosity(float c) {
+	params.xsphViscosity = std::max(c, 0.0f);
+}
+void GPU_FluidSimulator::setVorticityConfinement(float eps) {
+	params.vorticityEpsilon = std::max(eps, 0.0f);
+}
+void GPU_FluidSimulator::setArtificialPressure(float k, float deltaQ) {
+	corrK = std::max(k, 0.0f);
+	corrDeltaQCooff = std::max(deltaQ, 0.0f);
+	updateArtificialPressure();
+}
+void GPU_FluidSimulator::updateArtificialPressure() {
+	// 与 fluidCommon.glsl 的 poly6 相同：POLY6_COEFF * x^3，x = (h^2 - r^2) / h^3；Δq 不小于 h 时 W = 0，关闭 scorr
+	const float h = params.h;
+	const float deltaQ = corrDeltaQCooff * h;
+	const float x = (h * h - deltaQ * deltaQ) / (h * h * h);
+	const float w = deltaQ < h ? 315.0f / (64.0f * std::numbers::pi_v<float>) * x * x * x : 0.0f;
+	params.scorrK = -corrK;
+	params.invRefPoly6 = w > 0.0f ? 1.0f / w : 0.0f;
+}
+void GPU_FluidSimulator::setPairCache(int capacity) {
+	params.pairCacheCapacity = static_cast<uint32_t>(std::max(capacity, 0));
+	if (particleSSBO[gpustream::PosLambda]) {
+		allocatePairCache(); // onStart 之后调用时立即重新分配
+	}
+}
+void GPU_FluidSimulator::setTiledNeighbours(bool enable) {
+	tiledNeighbours = enable;
+}
+
+void GPU_FluidSimulator::setReorderInterval(int interval) {
+	reorderInterval = std::max(interval, 0);
+	if (particleSSBO[gpustream::PosLambda]) {
+		allocateReorderBuffer(); // onStart 之后调用时立即分配或释放
+	}
+}
 void GPU_FluidSimulator::onStart() {
 	// 初始化 SSBO 和 UBO
 	LOG_INFO << "particlePos.size() = " << particlePos.size();
 	LOG_INFO << "Expected = " << params.numParticles;
 	LOG_INFO << "sizeof(GPU_Particle) = " << sizeof(GPU_Particle);
-	glGenBuffers(1, &particleSSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, params.numParticles * sizeof(GPU_Particle), particlePos.data(), GL_DYNAMIC_DRAW); // pos + vel
-	// bind to shader binding 1 (Particles uses binding = 1 in fluidCommon.glsl)
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particleSSBO);
+	assignMissingIds(particlePos);
+	glGenBuffers(gpustream::Count, particleSSBO);
+	uploadParticles(particlePos.data(), true);
 
 	glGenBuffers(1, &cellIndexSSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellIndexSSBO);
-//	GLuint totalCells = params.gridSize.x() * params.gridSize.y() * params.gridSize.z();
-	GLuint totalCells = params.gridSizeX * params.gridSizeY * params.gridSizeZ;
-	glBufferData(GL_SHADER_STORAGE_BUFFER, totalCells * params.maxNeighboursPerCell * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
-	// bind to shader binding 2 (CellParticleIndices uses binding = 2)
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellIndexSSBO);
-
 	glGenBuffers(1, &cellCountSSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountSSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, totalCells * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
-	// bind to shader binding 3 (CellCounts uses binding = 3)
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellCountSSBO);
+	glGenBuffers(1, &cellStartSSBO);
+	glGenBuffers(1, &particleRankSSBO);
+	glGenBuffers(1, &scanBlockSSBO);
+	glGenBuffers(1, &cellTileSSBO);
+	allocateGridBuffers();
+	allocatePairCache();
+	allocateReorderBuffer();
 
 	glGenBuffers(1, &paramsUBO);
 	glBindBuffer(GL_UNIFORM_BUFFER, paramsUBO);
 	glBufferData(GL_UNIFORM_BUFFER, sizeof(GPUFluidParams), &params, GL_DYNAMIC_DRAW);
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, paramsUBO);
 
+	glGenBuffers(1, &statsSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GPUStepStats), nullptr, GL_DYNAMIC_COPY);
+	// bind to shader binding 4 (StepStatsBuffer uses binding = 4)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, statsSSBO);
+	glGenBuffers(kStatsRing, statsReadback);
+	for (GLuint buffer : statsReadback) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GPUStepStats), nullptr, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
 	// 创建 compute shader 程序
 	std::string projectRoot = getProjectPath();
 	clearGridProgram = createComputeShaderProgram("csClearGrid.comp");
@@ -159,6 +279,219 @@ void GPU_FluidSimulator::onStart() {
 	computeLambdaProgram = createComputeShaderProgram("csComputeLambda.comp");
 	computeDeltaProgram = createComputeShaderProgram("csComputeDeltaAndApply.comp");
 	epilogueProgram = createComputeShaderProgram("csEpilogue.comp");
+	viscosityVorticityProgram = createComputeShaderProgram("csViscosityVorticity.comp");
+	gridStatsProgram = createComputeShaderProgram("csGridStats.comp");
+	particleStatsProgram = createComputeShaderProgram("csParticleStats.comp");
+	packParticlesProgram = createComputeShaderProgram("csPackParticles.comp");
+	scanCellsProgram = createComputeShaderProgram("csScanCells.comp");
+	scanBlockSumsProgram = createComputeShaderProgram("csScanBlockSums.comp");
+	scanAddProgram = createComputeShaderProgram("csScanAdd.comp");
+	scatterGridProgram = createComputeShaderProgram("csScatterGrid.comp");
+	reorderProgram = createComputeShaderProgram("csReorderParticles.comp");
+	buildCellTilesProgram = createComputeShaderProgram("csBuildCellTiles.comp");
+	computeLambdaTiledProgram = createComputeShaderProgram("csComputeLambdaTiled.comp");
+	computeDeltaTiledProgram = createComputeShaderProgram("csComputeDeltaAndApplyTiled.comp");
+	// 着色通道为密度约束 C = ρ/ρ0 - 1，与 PointRender 相同的区间
+	glProgramUniform2f(packParticlesProgram, glGetUniformLocation(packParticlesProgram, "scalarRange"), -1.0f, 1.0f);
+}
+
+void GPU_FluidSimulator::allocateGridBuffers() {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellIndexSSBO);
+//	GLuint totalCells = params.gridSize.x() * params.gridSize.y() * params.gridSize.z();
+	// 网格按坐标哈希到 cellTableSize 个槽中，缓冲大小只与粒子数有关
+	GLuint totalCells = params.cellTableSize;
+	// 紧凑的单元列表：每个粒子恰好一项，100 万粒子时网格缓冲共约 16 MB
+	const auto particles = static_cast<GLsizeiptr>(std::max(params.numParticles, 1));
+	glBufferData(GL_SHADER_STORAGE_BUFFER, particles * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 2 (CellParticleIndices uses binding = 2)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellIndexSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellCountSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, totalCells * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 3 (CellCounts uses binding = 3)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellCountSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellStartSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, totalCells * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 8 (CellStart uses binding = 8)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, cellStartSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleRankSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, particles * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 9 (ParticleCellRank uses binding = 9)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, particleRankSSBO);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, scanBlockSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, scanBlocks() * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 10 (ScanBlockSums uses binding = 10 in scanCommon.glsl)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, scanBlockSSBO);
+
+	// 4 个字的间接派发参数与计数，之后是非空槽列表；非空槽数不会超过粒子数
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, cellTileSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, (4 + particles) * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+	// bind to shader binding 18 (CellTiles uses binding = 18)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 18, cellTileSSBO);
+}
+
+void GPU_FluidSimulator::allocatePairCache() {
+	if (!pairCacheSSBO) glGenBuffers(1, &pairCacheSSBO);
+	if (!pairNeighbourSSBO) glGenBuffers(1, &pairNeighbourSSBO);
+	// 关闭时着色器不会访问，但绑定点上仍要有缓冲
+	const GLsizeiptr entries = std::max<GLsizeiptr>(
+		static_cast<GLsizeiptr>(params.pairCacheCapacity) * params.numParticles, 1);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pairCacheSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, entries * 4 * sizeof(GLfloat), nullptr, GL_DYNAMIC_COPY);
+	// bind to shader binding 5 (PairCache uses binding = 5)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, pairCacheSSBO);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, pairNeighbourSSBO);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, entries * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	// bind to shader binding 6 (PairNeighbours uses binding = 6)
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, pairNeighbourSSBO);
+}
+
+void GPU_FluidSimulator::uploadParticles(const GPU_Particle* src, bool reallocate) {
+	std::vector<Eigen::Vector4f> posLambda, velocity, oldPos;
+	std::vector<GPU_ParticleAux> aux;
+	gpustream::split(src, static_cast<std::size_t>(params.numParticles), posLambda, velocity, oldPos, aux);
+	const void* data[gpustream::Count] = {posLambda.data(), velocity.data(), oldPos.data(), aux.data()};
+	uploadStreams(data, reallocate);
+}
+
+void GPU_FluidSimulator::uploadStreams(const void* const* data, bool reallocate) {
+	const auto bytes = static_cast<GLsizeiptr>(params.numParticles * gpustream::kStride);
+	for (int s = 0; s < gpustream::Count; s++) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSSBO[s]);
+		if (reallocate) {
+			glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, data[s], GL_DYNAMIC_DRAW);
+		} else {
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data[s]);
+		}
+		// bind to shader binding 1 / 12 / 13 / 14 (ParticlePosLambda / ParticleVelocity / ParticleOldPos / ParticleAuxBuffer)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kParticleBinding[s], particleSSBO[s]);
+	}
+}
+
+void GPU_FluidSimulator::allocateReorderBuffer() {
+	if (reorderInterval == 0) {
+		glDeleteBuffers(gpustream::Count, particleBackSSBO);
+		std::fill(std::begin(particleBackSSBO), std::end(particleBackSSBO), 0u);
+		return;
+	}
+	if (!particleBackSSBO[gpustream::PosLambda]) glGenBuffers(gpustream::Count, particleBackSSBO);
+	for (GLuint buffer : particleBackSSBO) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, params.numParticles * gpustream::kStride, nullptr, GL_DYNAMIC_DRAW);
+	}
+}
+
+void GPU_FluidSimulator::reorderParticles() {
+	// bind to shader binding 11 / 15 / 16 / 17 (SortedPosLambda / SortedVelocity / SortedOldPos / SortedAux)
+	for (int s = 0; s < gpustream::Count; s++) {
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kSortedBinding[s], particleBackSSBO[s]);
+	}
+	dispatchComputeShader(reorderProgram, (params.numParticles + 255) / 256);
+	for (int s = 0; s < gpustream::Count; s++) {
+		std::swap(particleSSBO[s], particleBackSSBO[s]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kParticleBinding[s], particleSSBO[s]);
+	}
+}
+
+bool GPU_FluidSimulator::save(const std::string& path) {
+	checkpoint::FileHeader header;
+	header.particleCount = static_cast<uint64_t>(params.numParticles);
+	header.stepCount = params.stepIndex;
+	header.solver = checkpoint::kSolverGPU;
+	header.seed = params.seed;
+	header.pbfNumIters = static_cast<uint32_t>(params.pbfNumIters);
+	header.dt = params.dt;
+	header.h = params.h;
+	header.mass = params.mass;
+	header.rho = params.rho;
+	header.lambdaEpsilon = params.lambdaEpsilon;
+	header.neighbourRadius = params.neighbourRadius;
+	header.cellSize = params.cellSize;
+	header.boundaryMin[0] = params.boundaryMinX;
+	header.boundaryMin[1] = params.boundaryMinY;
+	header.boundaryMin[2] = params.boundaryMinZ;
+	header.boundaryMax[0] = params.boundaryMaxX;
+	header.boundaryMax[1] = params.boundaryMaxY;
+	header.boundaryMax[2] = params.boundaryMaxZ;
+	const auto n = static_cast<std::size_t>(params.numParticles);
+	std::vector<Eigen::Vector4f> posLambda(n), velocity(n), oldPos(n);
+	std::vector<GPU_ParticleAux> aux(n);
+	if (particleSSBO[gpustream::PosLambda]) {
+		// 回读四个粒子缓冲（会等待之前的 compute 完成），每个缓冲原样写成一个块
+		void* data[gpustream::Count] = {posLambda.data(), velocity.data(), oldPos.data(), aux.data()};
+		for (int s = 0; s < gpustream::Count; s++) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, particleSSBO[s]);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, static_cast<GLsizeiptr>(n * gpustream::kStride), data[s]);
+		}
+	} else {
+		// 还没有创建缓冲，保存初始粒子
+		gpustream::split(particlePos.data(), n, posLambda, velocity, oldPos, aux);
+	}
+	checkpoint::Writer writer(header);
+	writer.addBlock(kStreamBlock[gpustream::PosLambda], posLambda.data(), gpustream::kStride, n);
+	writer.addBlock(kStreamBlock[gpustream::Velocity], velocity.data(), gpustream::kStride, n);
+	writer.addBlock(kStreamBlock[gpustream::OldPos], oldPos.data(), gpustream::kStride, n);
+	writer.addBlock(kStreamBlock[gpustream::Aux], aux.data(), gpustream::kStride, n);
+	return writer.write(path);
+}
+
+bool GPU_FluidSimulator::load(const std::string& path) {
+	checkpoint::Reader reader;
+	if (!reader.open(path)) return false;
+	const checkpoint::FileHeader& header = reader.header();
+	const void* streams[gpustream::Count];
+	bool complete = header.solver == checkpoint::kSolverGPU;
+	for (int s = 0; s < gpustream::Count; s++) {
+		streams[s] = reader.block(kStreamBlock[s], gpustream::kStride);
+		complete = complete && streams[s];
+	}
+	if (!complete) {
+		LOG_ERROR << "checkpoint " << path << " has no GPU particle blocks";
+		return false;
+	}
+	const int n = static_cast<int>(header.particleCount);
+	const bool resized = n != params.numParticles;
+	params.numParticles = n;
+	params.cellTableSize = std::bit_ceil(static_cast<uint32_t>(std::max(n, 1024)));
+	params.stepIndex = static_cast<uint32_t>(header.stepCount);
+	params.seed = header.seed;
+	params.pbfNumIters = static_cast<int>(header.pbfNumIters);
+	params.dt = header.dt;
+	params.h = header.h;
+	params.mass = header.mass;
+	params.rho = header.rho;
+	params.lambdaEpsilon = header.lambdaEpsilon;
+	params.neighbourRadius = header.neighbourRadius;
+	params.cellSize = header.cellSize;
+	params.boundaryMinX = header.boundaryMin[0];
+	params.boundaryMinY = header.boundaryMin[1];
+	params.boundaryMinZ = header.boundaryMin[2];
+	params.boundaryMaxX = header.boundaryMax[0];
+	params.boundaryMaxY = header.boundaryMax[1];
+	params.boundaryMaxZ = header.boundaryMax[2];
+	updateArtificialPressure(); // W(Δq) 随 h 变化
+	if (!particleSSBO[gpustream::PosLambda]) {
+		// 还没有创建缓冲，合并为初始粒子，onStart 时一起上传
+		particlePos.resize(n);
+		gpustream::merge(static_cast<const Eigen::Vector4f*>(streams[gpustream::PosLambda]),
+		                 static_cast<const Eigen::Vector4f*>(streams[gpustream::Velocity]),
+		                 static_cast<const Eigen::Vector4f*>(streams[gpustream::OldPos]),
+		                 static_cast<const GPU_ParticleAux*>(streams[gpustream::Aux]), n, particlePos.data());
+	} else {
+		// 块与粒子缓冲的布局相同，直接从映射的文件上传
+		uploadStreams(streams, resized);
+		if (resized) {
+			allocateGridBuffers();
+			allocatePairCache();
+			allocateReorderBuffer();
+		}
+		uploadParams();
+	}
+	LOG_INFO << "Loaded " << n << " GPU particles at step " << params.stepIndex << " from " << path;
+	return true;
 }
 
 void GPU_FluidSimulator::uploadParams() {
@@ -179,33 +512,288 @@ void GPU_FluidSimulator::dispatchComputeShader(GLuint program, GLuint numGroups)
 	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
 }
 
+void GPU_FluidSimulator::dispatchTiled(GLuint program) {
+	if (!glIsProgram(program)) {
+		LOG_ERROR << "Invalid compute program — skipping dispatch.";
+		return;
+	}
+	glUseProgram(program);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, cellTileSSBO);
+	glDispatchComputeIndirect(0);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
 void GPU_FluidSimulator::Update(float deltaTime) {
 	uploadParams();
 
 	// 1. 计算粒子和网格两个不同的 group 数
 	GLuint groupsParticles = (params.numParticles + 255) / 256;
 
-	GLuint totalCells = params.gridSizeX * params.gridSizeY * params.gridSizeZ;
+	GLuint totalCells = params.cellTableSize;
 	GLuint groupsCells = (totalCells + 255) / 256;
 
+	// 每次派发之后打一个时间戳，耗时计入对应的阶段；关闭计时时 mark 什么也不做
+	if (timingEnabled) stageTimer.beginFrame(params.stepIndex);
 	dispatchComputeShader(clearGridProgram, groupsCells);
+	stageTimer.mark(GPU_Stage::ClearGrid);
 
 	dispatchComputeShader(predictAndBuildGridProgram, groupsParticles);
+	stageTimer.mark(GPU_Stage::PredictAndBuildGrid);
+	// 计数 -> 排他前缀和 -> 分散写入，得到按槽排序的紧凑单元列表
+	dispatchComputeShader(scanCellsProgram, scanBlocks());
+	dispatchComputeShader(scanBlockSumsProgram, 1);
+	dispatchComputeShader(scanAddProgram, groupsCells);
+	stageTimer.mark(GPU_Stage::ScanCells);
+	dispatchComputeShader(scatterGridProgram, groupsParticles);
+	stageTimer.mark(GPU_Stage::ScatterGrid);
+	if (reorderInterval > 0 && params.stepIndex % static_cast<uint32_t>(reorderInterval) == 0) {
+		reorderParticles();
+		stageTimer.mark(GPU_Stage::Reorder);
+	}
+	if (statsEnabled) {
+		dispatchComputeShader(gridStatsProgram, groupsCells);
+		stageTimer.mark(GPU_Stage::GridStats);
+	}
+	if (tiledNeighbours) {
+		// 非空槽列表与间接派发参数；网格在迭代中不变，每步只建一次
+		dispatchComputeShader(buildCellTilesProgram, groupsCells);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+		stageTimer.mark(GPU_Stage::BuildCellTiles);
+	}
 
 	for (int iter = 0; iter < params.pbfNumIters; ++iter) {
-		dispatchComputeShader(computeLambdaProgram, groupsParticles);
-		dispatchComputeShader(computeDeltaProgram, groupsParticles);
+		if (tiledNeighbours) {
+			dispatchTiled(computeLambdaTiledProgram);
+			stageTimer.mark(GPU_Stage::Lambda);
+			dispatchTiled(computeDeltaTiledProgram);
+			stageTimer.mark(GPU_Stage::Delta);
+		} else {
+			dispatchComputeShader(computeLambdaProgram, groupsParticles);
+			stageTimer.mark(GPU_Stage::Lambda);
+			dispatchComputeShader(computeDeltaProgram, groupsParticles);
+			stageTimer.mark(GPU_Stage::Delta);
+		}
+	}
+
+	if (statsEnabled) {
+		dispatchComputeShader(particleStatsProgram, groupsParticles);
+		stageTimer.mark(GPU_Stage::ParticleStats);
 	}
 
 	dispatchComputeShader(epilogueProgram, groupsParticles);
+	stageTimer.mark(GPU_Stage::Epilogue);
+	if (params.xsphViscosity > 0.0f || params.vorticityEpsilon > 0.0f) {
+		dispatchComputeShader(viscosityVorticityProgram, groupsParticles);
+		stageTimer.mark(GPU_Stage::ViscosityVorticity);
+	}
+	stageTimer.endFrame();
+	if (statsEnabled) readbackStats();
+	// 统计与计时各自异步收回，按步数对应
+	if (const GPU_StageTimer::Frame* frame = stageTimer.find(stepStats.step)) {
+		stepStats.phases = frame->phases();
+	}
+	params.stepIndex++;
+
+	if (frameExporter) {
+		pollReadback();
+		if (frameExporter->shouldCapture()) {
+			if (readbackFence) {
+				frameExporter->skipFrame(); // 同一时间只保留一次回读
+			} else {
+				requestReadback();
+			}
+		}
+	}
+}
+
+void GPU_FluidSimulator::setStatsEnabled(bool enable) {
+	statsEnabled = enable;
+}
+
+void GPU_FluidSimulator::setTimingEnabled(bool enable) {
+	timingEnabled = enable;
+}
+
+void GPU_FluidSimulator::readbackStats() {
+	// 1. 按提交顺序收回已完成的统计，较新的覆盖较旧的
+	for (int k = 0; k < kStatsRing; k++) {
+		const int slot = (statsHead + k) % kStatsRing;
+		if (!statsFence[slot]) continue;
+		const GLenum status = glClientWaitSync(statsFence[slot], 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) break; // 之后提交的也不会完成
+		glDeleteSync(statsFence[slot]);
+		statsFence[slot] = nullptr;
+		if (status == GL_WAIT_FAILED) continue;
+
+		GPUStepStats raw{};
+		glBindBuffer(GL_COPY_READ_BUFFER, statsReadback[slot]);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(raw), &raw);
+		stepStats.step = statsStep[slot];
+		stepStats.phases = {}; // 由 Update 按步数从计时结果中填入
+		stepStats.iterations = params.pbfNumIters;
+		stepStats.densityErrorMax = std::bit_cast<float>(raw.densityErrorMax);
+		stepStats.densityErrorAvg = static_cast<float>(raw.densityErrorSum) / GPUStepStats::kDensityErrorScale /
+		                            static_cast<float>(std::max(params.numParticles, 1));
+		std::copy(std::begin(raw.neighbourHistogram), std::end(raw.neighbourHistogram), stepStats.neighbourHistogram.begin());
+		stepStats.truncatedParticles = 0; // 着色器不限制邻居数
+		stepStats.droppedNeighbours = 0;
+		stepStats.cellOverflows = raw.cellOverflows;
+		stepStats.occupiedCells = raw.occupiedCells;
+		stepStats.maxCellOccupancy = raw.maxCellOccupancy;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	// 2. 提交本步的拷贝；环已满说明 GPU 落后太多，跳过这一步而不是等待
+	if (statsFence[statsHead]) return;
+	glBindBuffer(GL_COPY_READ_BUFFER, statsSSBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, statsReadback[statsHead]);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(GPUStepStats));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	statsFence[statsHead] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	statsStep[statsHead] = params.stepIndex;
+	statsHead = (statsHead + 1) % kStatsRing;
+}
+
+void GPU_FluidSimulator::setFrameExporter(FrameExporter* exporter) {
+	frameExporter = exporter;
+}
+
+void GPU_FluidSimulator::setPackedReadback(bool enable) {
+	packedReadback = enable;
+}
+
+void GPU_FluidSimulator::requestReadback() {
+	// 紧凑格式：前 n 个 PackedParticle，之后 n 对半精度（vel.xy，vel.z 与密度约束）
+	// 否则依次拷贝位置与 λ、速度、辅助属性三个缓冲，旧位置不需要
+	constexpr GLsizeiptr kPackedBytes = sizeof(packed::PackedParticle) + 2 * sizeof(uint32_t);
+	constexpr gpustream::Stream kExported[] = {gpustream::PosLambda, gpustream::Velocity, gpustream::Aux};
+	const auto streamBytes = static_cast<GLsizeiptr>(gpustream::kStride) * params.numParticles;
+	const GLsizeiptr bytes = packedReadback ? kPackedBytes * params.numParticles
+	                                        : streamBytes * static_cast<GLsizeiptr>(std::size(kExported));
+	if (packedReadback) {
+		if (!packedSSBO) glGenBuffers(1, &packedSSBO);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, packedSSBO);
+		GLint64 size = 0;
+		glGetBufferParameteri64v(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &size);
+		if (size < bytes) glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_STREAM_COPY);
+		// bind to shader binding 7 (PackedParticles uses binding = 7 in csPackParticles.comp)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, packedSSBO);
+		dispatchComputeShader(packParticlesProgram, (params.numParticles + 255) / 256);
+	}
+	if (!readbackBuffer) glGenBuffers(1, &readbackBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+	if (bytes > readbackCapacity) {
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		readbackCapacity = bytes;
+	}
+	// epilogue 之后的 GL_BUFFER_UPDATE_BARRIER_BIT 保证拷贝读到的是本步的结果
+	if (packedReadback) {
+		glBindBuffer(GL_COPY_READ_BUFFER, packedSSBO);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, bytes);
+	} else {
+		for (std::size_t k = 0; k < std::size(kExported); k++) {
+			glBindBuffer(GL_COPY_READ_BUFFER, particleSSBO[kExported[k]]);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, static_cast<GLintptr>(k) * streamBytes, streamBytes);
+		}
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackStep = params.stepIndex;
+	readbackCount = params.numParticles;
+	readbackPacked = packedReadback;
+}
+
+void GPU_FluidSimulator::pollReadback() {
+	if (!readbackFence) return;
+	// 超时为 0：只查询状态，GPU 还没执行到拷贝时留到下一次 Update
+	const GLenum status = glClientWaitSync(readbackFence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) return;
+	glDeleteSync(readbackFence);
+	readbackFence = nullptr;
+	if (status == GL_WAIT_FAILED) {
+		LOG_ERROR << "GPU_FluidSimulator: readback fence failed";
+		return;
+	}
+	std::unique_ptr<ExportFrame> frame = frameExporter->acquireFrame();
+	if (!frame) return;
+
+	const auto n = static_cast<std::size_t>(readbackCount);
+	if (readbackPacked) {
+		pollPackedReadback(std::move(frame), n);
+		return;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+	const auto* src = static_cast<const uint8_t*>(glMapBufferRange(
+		GL_COPY_READ_BUFFER, 0, static_cast<GLsizeiptr>(3 * gpustream::kStride * n), GL_MAP_READ_BIT));
+	if (src) {
+		// 回读缓冲中依次是位置与 λ、速度、辅助属性，见 requestReadback
+		const auto* posLambda = reinterpret_cast<const Eigen::Vector4f*>(src);
+		const auto* velocity = reinterpret_cast<const Eigen::Vector4f*>(src + gpustream::kStride * n);
+		const auto* aux = reinterpret_cast<const GPU_ParticleAux*>(src + 2 * gpustream::kStride * n);
+		// 开启网格重排后下标不再是编号，由导出器按 id 对应
+		frame->resize(n, true);
+		frame->step = readbackStep;
+		for (std::size_t i = 0; i < n; i++) {
+			frame->id[i] = aux[i].id;
+			frame->x[i] = posLambda[i].x();
+			frame->y[i] = posLambda[i].y();
+			frame->z[i] = posLambda[i].z();
+			frame->vx[i] = velocity[i].x();
+			frame->vy[i] = velocity[i].y();
+			frame->vz[i] = velocity[i].z();
+			frame->density[i] = aux[i].density;
+		}
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		frameExporter->submit(std::move(frame));
+	} else {
+		LOG_ERROR << "GPU_FluidSimulator: failed to map readback buffer";
+		frameExporter->cancelFrame(std::move(frame));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+void GPU_FluidSimulator::pollPackedReadback(std::unique_ptr<ExportFrame> frame, std::size_t n) {
+	const auto bytes = static_cast<GLsizeiptr>((sizeof(packed::PackedParticle) + 2 * sizeof(uint32_t)) * n);
+	glBindBuffer(GL_COPY_READ_BUFFER, readbackBuffer);
+	const auto* src = static_cast<const uint8_t*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, bytes, GL_MAP_READ_BIT));
+	if (src) {
+		frame->resize(n, false);
+		frame->step = readbackStep;
+		// csPackParticles 已按编号写入；位置用 SIMD 解码，density 取半精度的通道，8 位的着色通道只用于显示
+		packed::Range range;
+		range.aabbMin[0] = params.boundaryMinX;
+		range.aabbMin[1] = params.boundaryMinY;
+		range.aabbMin[2] = params.boundaryMinZ;
+		range.aabbMax[0] = params.boundaryMaxX;
+		range.aabbMax[1] = params.boundaryMaxY;
+		range.aabbMax[2] = params.boundaryMaxZ;
+		packed::decode(reinterpret_cast<const packed::PackedParticle*>(src), n, range, frame->x.data(),
+		               frame->y.data(), frame->z.data(), nullptr);
+		const auto* halves = reinterpret_cast<const uint16_t*>(src + sizeof(packed::PackedParticle) * n);
+		for (std::size_t i = 0; i < n; i++) {
+			frame->vx[i] = packed::halfToFloat(halves[4 * i + 0]);
+			frame->vy[i] = packed::halfToFloat(halves[4 * i + 1]);
+			frame->vz[i] = packed::halfToFloat(halves[4 * i + 2]);
+			frame->density[i] = packed::halfToFloat(halves[4 * i + 3]);
+		}
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		frameExporter->submit(std::move(frame));
+	} else {
+		LOG_ERROR << "GPU_FluidSimulator: failed to map readback buffer";
+		frameExporter->cancelFrame(std::move(frame));
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
 }
 
 void GPU_FluidSimulator::onDetach() {
 	LOG_INFO << "GPU_FluidSimulator detached";
 }
 
-GLuint GPU_FluidSimulator::getParticleSSBO() const {
-	return particleSSBO;
+GLuint GPU_FluidSimulator::getParticleSSBO(gpustream::Stream stream) const {
+	return particleSSBO[stream];
 }
 
 GLuint GPU_FluidSimulator::getCellIndexSSBO() const {
@@ -216,6 +804,10 @@ GLuint GPU_FluidSimulator::getCellCountSSBO() const {
 	return cellCountSSBO;
 }
 
+GLuint GPU_FluidSimulator::getCellStartSSBO() const {
+	return cellStartSSBO;
+}
+
 GLuint GPU_FluidSimulator::getParamsUBO() const {
 	return paramsUBO;
 }
@@ -5,6 +5,9 @@
 #ifndef LEARNOPENGL_GPU_FLUIDSIMULATOR_H
 #define LEARNOPENGL_GPU_FLUIDSIMULATOR_H
 // C++ Headers
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 // External Headers
 #ifdef __linux__
@@ -18,6 +21,12 @@
 #include "Utils/ReadShader.h"
 #include "ECS/Components/Component.h"
 #include "GPU_Particle.h"
+#include "GPU_StageTimer.h"
+#include "Rendering/Assets/fluid/Scenario.h"
+#include "Rendering/Assets/fluid/StepStats.h"
+
+class FrameExporter;
+struct ExportFrame;
 
 //struct GPUFluidParams {
 //	float dt = 0.05f;
@@ -43,11 +52,11 @@ struct GPUFluidParams {
 	float rho = 1.0f;
 	float neighbourRadius = 1.05f;
 	float lambdaEpsilon = 100.0f;
-	// std140 这里为了让下一个 ivec3 按 16 对齐，会留 2 个 float 空位
-	float _padScalar0 = 0.0f;
-	float _padScalar1 = 0.0f;
+	// std140 这里为了让下一个 ivec3 按 16 对齐，会留 2 个 4 字节空位，用来放随机数的种子与步数
+	uint32_t seed = 0x5eedu; // 随机数种子（Utils/CounterRNG.h 与 fluidCommon.glsl 共用）
+	uint32_t stepIndex = 0;  // 已执行的步数，每次 Update 后加一
 
-	// --- gridSize + cellSize ---
+	// --- gridSize + cellSize ---（网格改为哈希表后 gridSize 不再决定缓冲大小）
 	int   gridSizeX = 32;
 	int   gridSizeY = 2000;
 	int   gridSizeZ = 32;
@@ -66,18 +75,47 @@ struct GPUFluidParams {
 	float _pad1 = 0.0f;  // 对应 GLSL 里的 _pad1
 
 	// --- 后面 3 个 int + pad ---
-	int maxNeighboursPerCell = 40;
+	int maxNeighboursPerCell = 40; // 网格改为紧凑的单元列表后不再使用，只保留布局
 	int numParticles;
 	int pbfNumIters = 4;
-	int _pad2 = 0; // 对齐到 16 的倍数
+	uint32_t cellTableSize = 0; // 网格哈希表的槽数（2 的幂），在构造函数中按粒子数确定
+
+	// --- XSPH 粘性与涡量约束（0 表示关闭）+ 邻居对缓存容量 + pad ---
+	float xsphViscosity = 0.0f;
+	float vorticityEpsilon = 0.0f;
+	uint32_t pairCacheCapacity = 0; // 邻居对缓存每个粒子的容量，0 表示关闭
+	float _pad3 = 0.0f;
+
+	// --- 人工压力 scorr = scorrK * (W(r) / W(Δq))^4 + pad ---（由 setArtificialPressure 换算）
+	float scorrK = -0.001f;
+	float invRefPoly6 = 0.0f; // 1 / W(Δq)，0 表示关闭
+	float _pad4 = 0.0f;
+	float _pad5 = 0.0f;
 };
 
 
+// 统计 SSBO 的布局（std430，binding = 4），与 fluidCommon.glsl 中的 StepStatsBuffer 一致
+struct GPUStepStats {
+	uint32_t cellOverflows;
+	uint32_t occupiedCells;
+	uint32_t maxCellOccupancy;
+	uint32_t densityErrorMax; // float 的位模式
+	uint32_t densityErrorSum; // 定点数，乘以 kDensityErrorScale
+	uint32_t _pad[3];
+	uint32_t neighbourHistogram[StepStats::kNeighbourBins];
+
+	static constexpr float kDensityErrorScale = 64.0f; // 与 STATS_DENSITY_ERROR_SCALE 一致
+};
+static_assert(sizeof(GPUStepStats) == 96);
+
 class GPU_FluidSimulator : public Component{
 private: // 参数
 	GPUFluidParams params;
 //	Eigen::Vector4f particlePos[30001]; // 存储粒子位置的数组，最多30000个粒子
 	std::vector<GPU_Particle> particlePos;
+	std::optional<scenario::Layout> initialLayout; // 未设置时使用 onAttach 中默认的溃坝布局
+	float corrDeltaQCooff = 0.3f, corrK = 0.001f; // 人工压力 scorr 的参数 Δq / h 与 k，与 CPU 求解器相同
+	void updateArtificialPressure(); // 按当前的 h 换算 params.scorrK / invRefPoly6
 public:
 	const GPUFluidParams &getParams() const;
 
@@ -87,19 +125,84 @@ private: // 程序对象
 	GLuint computeLambdaProgram;
 	GLuint computeDeltaProgram;
 	GLuint epilogueProgram;
+	GLuint viscosityVorticityProgram;
+	GLuint gridStatsProgram;
+	GLuint particleStatsProgram;
+	GLuint packParticlesProgram;
+	GLuint scanCellsProgram;
+	GLuint scanBlockSumsProgram;
+	GLuint scanAddProgram;
+	GLuint scatterGridProgram;
+	GLuint reorderProgram;
+	GLuint buildCellTilesProgram = 0;
+	GLuint computeLambdaTiledProgram = 0;
+	GLuint computeDeltaTiledProgram = 0;
 public:
-	GLuint getParticleSSBO() const;
+	// 当前的粒子缓冲（默认为位置与 λ）；开启网格重排后每次重排都会与备用缓冲交换，渲染时每帧重新获取
+	GLuint getParticleSSBO(gpustream::Stream stream = gpustream::PosLambda) const;
 	GLuint getCellIndexSSBO() const;
 	GLuint getCellCountSSBO() const;
+	GLuint getCellStartSSBO() const;
 	GLuint getParamsUBO() const;
 
 private:// 缓冲对象
-	GLuint particleSSBO; // 粒子位置 SSBO
-	GLuint cellIndexSSBO; // 网格索引 SSBO
+	GLuint particleSSBO[gpustream::Count] = {}; // 粒子 SSBO，按 gpustream 拆成四个缓冲
+	GLuint cellIndexSSBO; // 网格索引 SSBO：按槽排序的粒子下标，numParticles 项
 	GLuint cellCountSSBO; // 网格计数 SSBO
+	GLuint cellStartSSBO = 0; // 每个槽在 cellIndexSSBO 中的起点（计数的排他前缀和）
+	GLuint particleRankSSBO = 0; // 粒子在所属槽内的序号
+	GLuint scanBlockSSBO = 0; // 前缀和的块间进位
 	GLuint paramsUBO; // 参数 UBO
+	GLuint statsSSBO; // 每步统计 SSBO
+	GLuint pairCacheSSBO = 0; // 邻居对缓存：∇W 与 scorr
+	GLuint pairNeighbourSSBO = 0; // 邻居对缓存：邻居下标
+	GLuint packedSSBO = 0; // 紧凑回读：csPackParticles 的输出
+	GLuint particleBackSSBO[gpustream::Count] = {}; // 网格重排的 ping-pong 缓冲，重排后与 particleSSBO 交换
+	int reorderInterval = 0; // 每隔多少步按网格重排一次粒子，0 表示关闭
+	GLuint cellTileSSBO = 0; // 分块邻居遍历的间接派发参数与非空槽列表
+	bool tiledNeighbours = false; // lambda / delta 使用按网格分块的着色器
 private: // 变量
 	GLuint createComputeShaderProgram(const std::string& path);
+	void allocateGridBuffers(); // 按 cellTableSize 与粒子数分配网格缓冲
+	static constexpr GLuint kScanBlock = 1024; // 前缀和每个工作组处理的槽数，与 scanCommon.glsl 的 SCAN_BLOCK 一致
+	GLuint scanBlocks() const { return (params.cellTableSize + kScanBlock - 1) / kScanBlock; }
+	void allocatePairCache(); // 按 pairCacheCapacity 与粒子数分配邻居对缓存，容量为 0 时只保留最小的缓冲
+	void uploadParticles(const GPU_Particle* src, bool reallocate); // 拆分为四个缓冲后上传
+	void uploadStreams(const void* const* data, bool reallocate); // 按 gpustream 的顺序上传四个缓冲，reallocate 时按粒子数重新分配
+	void allocateReorderBuffer(); // 开启网格重排时按粒子数分配 ping-pong 缓冲，关闭时释放
+	void reorderParticles(); // csReorderParticles 写入备用缓冲后交换
+	void dispatchTiled(GLuint program); // 按 csBuildCellTiles 写入的参数间接派发
+
+private: // 帧导出
+	FrameExporter* frameExporter = nullptr;
+	GLuint readbackBuffer = 0; // GL_STREAM_READ 回读缓冲
+	GLsizeiptr readbackCapacity = 0;
+	GLsync readbackFence = nullptr; // 非空表示有一次回读尚未完成
+	uint64_t readbackStep = 0;
+	int readbackCount = 0;
+	bool packedReadback = false; // 回读 csPackParticles 压缩后的粒子（16 字节 / 粒子）而不是粒子缓冲（48 字节 / 粒子）
+	bool readbackPacked = false; // 尚未完成的回读是否为紧凑格式
+	void requestReadback(); // 拷贝位置、速度与辅助属性三个缓冲（或压缩后的 packedSSBO）并插入 fence
+	void pollReadback(); // fence 已完成时把回读结果转换为 ExportFrame 并提交
+	void pollPackedReadback(std::unique_ptr<ExportFrame> frame, std::size_t n); // 紧凑格式的解码
+
+private: // 统计
+	/*
+	 * 每步把统计 SSBO 拷贝到环形回读缓冲中的一个并插入 fence，之后的 Update 中按提交顺序收回已完成的项，
+	 * CPU 从不等待 GPU：getStepStats() 通常落后 1 ~ 2 帧，GPU 落后超过 kStatsRing 帧时跳过这一步的统计
+	 */
+	static constexpr int kStatsRing = 3;
+	bool statsEnabled = true;
+	StepStats stepStats;
+	GLuint statsReadback[kStatsRing] = {};
+	GLsync statsFence[kStatsRing] = {};
+	uint64_t statsStep[kStatsRing] = {};
+	int statsHead = 0; // 下一个写入的槽，也是最早提交的槽
+	void readbackStats(); // 收回已完成的统计并提交本步的拷贝
+
+private: // 计时
+	bool timingEnabled = true;
+	GPU_StageTimer stageTimer; // 每次派发之后的时间戳查询，同样异步收回
 public:
 	explicit GPU_FluidSimulator(int numParticles);
 	~GPU_FluidSimulator() override;
@@ -109,7 +212,41 @@ public:
 	void onDetach() override;
 	void Update(float deltaTime) override;
 
+	void setScenario(scenario::Layout layout); // 在 onAttach 之前调用，按 Scenario.h 生成初始粒子
+	// XSPH 粘性与涡量约束（与 CPU 求解器相同），开启任意一项时在 csEpilogue 之后多一次融合的邻居遍历
+	void setXSPHViscosity(float c);
+	void setVorticityConfinement(float eps);
+	// 人工压力 scorr = -k (W(r) / W(Δq))^4，Δq = deltaQ * h（与 CPU 求解器的 corrK / corrDeltaQCooff 相同），默认 0.001、0.3
+	void setArtificialPressure(float k, float deltaQ);
+	// 邻居对缓存：csComputeLambda 保存每个粒子前 capacity 个邻居的 ∇W 与 scorr（每项 20 字节），
+	// 同一次迭代的位置增量不再遍历网格；邻居数超过 capacity 的粒子照常遍历。0 表示关闭（默认）
+	void setPairCache(int capacity);
+	// 网格重排：每 interval 步在建好单元列表之后，把粒子按槽拷贝到 ping-pong 的另一个缓冲并交换，
+	// 同一个槽内的粒子在内存中连续，邻居遍历的读取可以合并。需要额外一份粒子缓冲（64 字节 / 粒子）。0 表示关闭（默认）
+	void setReorderInterval(int interval);
+	// 按网格分块的邻居遍历：lambda 与位置修正换成 csComputeLambdaTiled / csComputeDeltaAndApplyTiled，
+	// 每个工作组负责一个非空槽，27 个邻居槽的粒子分批协作读入共享内存，同一 cell 的粒子共用一次全局读取。
+	// 结果与逐粒子版本相同，哪个更快取决于硬件与每个 cell 的粒子数，可随时切换。默认关闭
+	void setTiledNeighbours(bool enable);
 	void uploadParams();
+	// 快照（格式见 Checkpoint.h）：save 回读四个粒子缓冲，每个缓冲写成一个块；load 从映射的文件直接上传四个块，
+	// 在 onStart 之前调用时替换初始粒子。失败时返回 false
+	bool save(const std::string& path);
+	bool load(const std::string& path);
+	// 帧导出（见 FrameExporter.h）：需要导出时把粒子缓冲异步拷贝到回读缓冲，
+	// 在之后的 Update 中 fence 完成时再映射并提交，不会让 CPU 等待 GPU。nullptr 表示关闭；不持有导出器
+	void setFrameExporter(FrameExporter* exporter);
+	// 紧凑回读：导出前先由 csPackParticles 把位置压缩为 PackedParticles.h 的格式（相对于模拟边界的 16 位定点数），
+	// 速度与密度约束压缩为半精度，回读量为 48 -> 16 字节 / 粒子；速度精度降为半精度（约 3 位有效数字）。默认关闭
+	void setPackedReadback(bool enable);
+	// 每步统计（见 StepStats.h）：两个归约 pass + 96 字节的异步回读，默认开启
+	void setStatsEnabled(bool enable);
+	const StepStats& getStepStats() const { return stepStats; } // 最近一次回读完成的统计
+	// 各阶段的 GPU 耗时（见 GPU_StageTimer.h）：每次派发之后一个时间戳查询，结果落后 2 ~ 3 帧收回，
+	// 提供每个阶段的滚动平均与百分位数，并填入 getStepStats().phases。默认开启
+	void setTimingEnabled(bool enable);
+	GPU_StageTimer& getStageTimer() { return stageTimer; }
+	const GPU_StageTimer& getStageTimer() const { return stageTimer; }
 	void dispatchComputeShader(GLuint program, GLuint numGroups);
 };
 
@@ -5,6 +5,8 @@
 #ifndef LEARNOPENGL_GPU_PARTICLE_H
 #define LEARNOPENGL_GPU_PARTICLE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 #ifdef __linux__
@@ -13,6 +15,10 @@
 #include <Eigen/Eigen>
 #endif
 
+/*
+ * 粒子的 AoS 记录，CPU 端生成初始粒子时使用
+ * GPU 端按访问频率拆成 gpustream 中的四个缓冲，上传时由 gpustream::split 拆分，onStart 之前加载快照时由 merge 合并
+ */
 struct GPU_Particle {
 	GPU_Particle() = default;
 	GPU_Particle(Eigen::Vector3f pos, Eigen::Vector3f vel = Eigen::Vector3f::Zero(), float density = 1.0f){
@@ -21,15 +27,71 @@ struct GPU_Particle {
 		this->density = density;
 	}
 	Eigen::Vector4f pos; // 粒子位置
-	Eigen::Vector4f vel; // 粒子速度
-	Eigen::Vector4f oldPos = Eigen::Vector4f::Zero();
+	Eigen::Vector4f vel; // 粒子速度，w 为本步的涡量大小 |ω|
+	Eigen::Vector4f oldPos = Eigen::Vector4f::Zero(); // 上一帧位置，w 为上一步的 |ω|
 	float lambda = 0; // 拉格朗日乘子
 	float density = 0; // 粒子密度（使用sph方法）
-	float _padA = 0; // padding
-	float _padB = 0; // padding
+	float neighbours = 0; // 最后一次 lambda 计算时的邻居数，由着色器写入（统计用）
+	uint32_t id = 0; // 粒子编号，按网格重排后导出时用它对应同一个粒子
 	~GPU_Particle() = default;
 
 	bool operator==(const GPU_Particle& rhs) const = default;
 };
 
+// 密度约束、邻居数与编号，只在统计、渲染与导出时读取
+struct GPU_ParticleAux {
+	float density = 0; // 密度约束 C = ρ/ρ0 - 1
+	float neighbours = 0; // 最后一次 lambda 计算时的邻居数
+	uint32_t id = 0; // 粒子编号
+	float _pad = 0;
+};
+static_assert(sizeof(GPU_ParticleAux) == 16);
+
+/*
+ * GPU 端的粒子缓冲（std430，每项 16 字节），与 fluidCommon.glsl 一致
+ * 邻居遍历只读 PosLambda，每个邻居 16 字节（原来的 GPU_Particle 为 64 字节）
+ */
+namespace gpustream {
+
+enum Stream : int {
+	PosLambda = 0, // xyz 预测位置，w 为 λ
+	Velocity,      // xyz 速度，w 为本步的 |ω|
+	OldPos,        // xyz 上一帧位置，w 为上一步的 |ω|
+	Aux,           // GPU_ParticleAux
+	Count
+};
+constexpr std::size_t kStride = 16;
+
+// AoS -> 四个分开的数组，每个数组 n 项
+inline void split(const GPU_Particle* src, std::size_t n, std::vector<Eigen::Vector4f>& posLambda,
+                  std::vector<Eigen::Vector4f>& velocity, std::vector<Eigen::Vector4f>& oldPos,
+                  std::vector<GPU_ParticleAux>& aux) {
+	posLambda.resize(n);
+	velocity.resize(n);
+	oldPos.resize(n);
+	aux.resize(n);
+	for (std::size_t i = 0; i < n; i++) {
+		posLambda[i] = {src[i].pos.x(), src[i].pos.y(), src[i].pos.z(), src[i].lambda};
+		velocity[i] = src[i].vel;
+		oldPos[i] = src[i].oldPos;
+		aux[i] = {src[i].density, src[i].neighbours, src[i].id, 0.0f};
+	}
+}
+
+// 四个数组 -> AoS；pos.w 固定为 1
+inline void merge(const Eigen::Vector4f* posLambda, const Eigen::Vector4f* velocity, const Eigen::Vector4f* oldPos,
+                  const GPU_ParticleAux* aux, std::size_t n, GPU_Particle* dst) {
+	for (std::size_t i = 0; i < n; i++) {
+		dst[i].pos = {posLambda[i].x(), posLambda[i].y(), posLambda[i].z(), 1.0f};
+		dst[i].lambda = posLambda[i].w();
+		dst[i].vel = velocity[i];
+		dst[i].oldPos = oldPos[i];
+		dst[i].density = aux[i].density;
+		dst[i].neighbours = aux[i].neighbours;
+		dst[i].id = aux[i].id;
+	}
+}
+
+} // namespace gpustream
+
 #endif //LEARNOPENGL_GPU_PARTICLE_H
@@ -0,0 +1,169 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "GPU_StageTimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kStages = static_cast<int>(GPU_Stage::Count);
+constexpr int kQueryChunk = 16; // 查询对象不够时每次增加的个数
+
+// 已排序样本的百分位数（最近秩）
+double percentile(const std::vector<double>& sorted, double p) {
+	const auto rank = static_cast<std::size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+	return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+} // namespace
+
+const char* gpuStageName(GPU_Stage stage) {
+	switch (stage) {
+		case GPU_Stage::ClearGrid:           return "clearGrid";
+		case GPU_Stage::PredictAndBuildGrid: return "predictAndBuildGrid";
+		case GPU_Stage::ScanCells:           return "scanCells";
+		case GPU_Stage::ScatterGrid:         return "scatterGrid";
+		case GPU_Stage::Reorder:             return "reorder";
+		case GPU_Stage::GridStats:           return "gridStats";
+		case GPU_Stage::BuildCellTiles:      return "buildCellTiles";
+		case GPU_Stage::Lambda:              return "lambda";
+		case GPU_Stage::Delta:               return "delta";
+		case GPU_Stage::ParticleStats:       return "particleStats";
+		case GPU_Stage::Epilogue:            return "epilogue";
+		case GPU_Stage::ViscosityVorticity:  return "viscosityVorticity";
+		case GPU_Stage::Total:               return "total";
+		case GPU_Stage::Count:               break;
+	}
+	return "unknown";
+}
+
+PhaseTimings GPU_StageTimer::Frame::phases() const {
+	auto at = [this](GPU_Stage stage) { return seconds[static_cast<int>(stage)]; };
+	PhaseTimings t;
+	t.reorder = at(GPU_Stage::Reorder);
+	t.prologue = at(GPU_Stage::ClearGrid) + at(GPU_Stage::PredictAndBuildGrid) + at(GPU_Stage::ScanCells) +
+	             at(GPU_Stage::ScatterGrid) + at(GPU_Stage::GridStats) + at(GPU_Stage::BuildCellTiles);
+	t.lambda = at(GPU_Stage::Lambda);
+	t.delta = at(GPU_Stage::Delta);
+	t.epilogue = at(GPU_Stage::ParticleStats) + at(GPU_Stage::Epilogue) + at(GPU_Stage::ViscosityVorticity);
+	t.steps = 1;
+	return t;
+}
+
+GPU_StageTimer::~GPU_StageTimer() {
+	for (Slot& slot : slots) {
+		if (!slot.queries.empty()) glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+	}
+}
+
+void GPU_StageTimer::beginFrame(uint64_t step) {
+	poll();
+	Slot& slot = slots[head];
+	if (slot.pending) {
+		// 环已满：GPU 落后超过 kRing 帧，丢弃最早一帧而不是等待
+		slot.pending = false;
+		dropped++;
+	}
+	slot.used = 0;
+	slot.step = step;
+	current = &slot;
+	mark(GPU_Stage::Total); // 第一个时间戳，标签不使用
+}
+
+void GPU_StageTimer::mark(GPU_Stage stage) {
+	if (!current) return;
+	Slot& slot = *current;
+	if (slot.used == static_cast<int>(slot.queries.size())) {
+		slot.queries.resize(slot.used + kQueryChunk);
+		slot.labels.resize(slot.used + kQueryChunk);
+		glGenQueries(kQueryChunk, slot.queries.data() + slot.used);
+	}
+	glQueryCounter(slot.queries[slot.used], GL_TIMESTAMP);
+	slot.labels[slot.used] = stage;
+	slot.used++;
+}
+
+void GPU_StageTimer::endFrame() {
+	if (!current) return;
+	current->pending = current->used > 1;
+	current = nullptr;
+	head = (head + 1) % kRing;
+}
+
+void GPU_StageTimer::poll() {
+	for (int k = 0; k < kRing; k++) {
+		Slot& slot = slots[(head + k) % kRing];
+		if (!slot.pending) continue;
+		// 时间戳按提交顺序完成，最后一个可用时之前的也都可用
+		GLint available = 0;
+		glGetQueryObjectiv(slot.queries[slot.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break; // 之后提交的也不会完成
+		resolve(slot);
+		slot.pending = false;
+	}
+}
+
+void GPU_StageTimer::resolve(Slot& slot) {
+	Frame& frame = recent[recentHead];
+	recentHead = (recentHead + 1) % static_cast<int>(recent.size());
+	recentCount = std::min(recentCount + 1, static_cast<int>(recent.size()));
+	frame = Frame{};
+	frame.step = slot.step;
+
+	GLuint64 previous = 0, first = 0;
+	for (int k = 0; k < slot.used; k++) {
+		GLuint64 timestamp = 0;
+		glGetQueryObjectui64v(slot.queries[k], GL_QUERY_RESULT, &timestamp);
+		if (k == 0) {
+			first = timestamp;
+		} else {
+			const int stage = static_cast<int>(slot.labels[k]);
+			frame.seconds[stage] += static_cast<double>(timestamp - previous) * 1e-9;
+			frame.ran[stage] = true;
+		}
+		previous = timestamp;
+	}
+	const int total = static_cast<int>(GPU_Stage::Total);
+	frame.seconds[total] = static_cast<double>(previous - first) * 1e-9;
+	frame.ran[total] = true;
+
+	for (int s = 0; s < kStages; s++) {
+		if (!frame.ran[s]) continue;
+		Window& w = windows[s];
+		w.samples[w.head] = frame.seconds[s] * 1e3;
+		w.head = (w.head + 1) % kWindow;
+		w.size = std::min(w.size + 1, kWindow);
+	}
+}
+
+GPU_StageSummary GPU_StageTimer::summary(GPU_Stage stage) const {
+	const Window& w = windows[static_cast<int>(stage)];
+	GPU_StageSummary s;
+	if (w.size == 0) return s;
+	std::vector<double> sorted(w.samples.begin(), w.samples.begin() + w.size);
+	std::sort(sorted.begin(), sorted.end());
+	double sum = 0.0;
+	for (double v : sorted) sum += v;
+	s.samples = w.size;
+	s.avgMs = sum / static_cast<double>(w.size);
+	s.p50Ms = percentile(sorted, 0.50);
+	s.p95Ms = percentile(sorted, 0.95);
+	s.p99Ms = percentile(sorted, 0.99);
+	s.maxMs = sorted.back();
+	return s;
+}
+
+const GPU_StageTimer::Frame* GPU_StageTimer::find(uint64_t step) const {
+	for (int k = 0; k < recentCount; k++) {
+		if (recent[k].step == step) return &recent[k];
+	}
+	return nullptr;
+}
+
+void GPU_StageTimer::reset() {
+	windows = {};
+	dropped = 0;
+}
@@ -0,0 +1,109 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_GPU_STAGETIMER_H
+#define LEARNOPENGL_GPU_STAGETIMER_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Rendering/Assets/fluid/StepStats.h"
+
+// GPU 求解器的计时阶段；同一阶段在一步内的多次派发（lambda / delta 的每次迭代）累加
+enum class GPU_Stage : int {
+	ClearGrid,
+	PredictAndBuildGrid,
+	ScanCells,           // 三个前缀和 pass
+	ScatterGrid,
+	Reorder,
+	GridStats,
+	BuildCellTiles,
+	Lambda,
+	Delta,
+	ParticleStats,
+	Epilogue,
+	ViscosityVorticity,
+	Total,               // 一步内第一个到最后一个时间戳
+	Count
+};
+
+const char* gpuStageName(GPU_Stage stage);
+
+// 一个阶段最近 kWindow 个样本（毫秒）的统计，只统计执行了该阶段的步
+struct GPU_StageSummary {
+	int samples = 0;
+	double avgMs = 0.0;
+	double p50Ms = 0.0;
+	double p95Ms = 0.0;
+	double p99Ms = 0.0;
+	double maxMs = 0.0;
+};
+
+/*
+ * 每次派发之后插入一个 GL_TIMESTAMP 查询（glQueryCounter），相邻时间戳之差记在后一个的阶段上
+ *  查询按帧放在 kRing 个槽组成的环中，每帧开始时按提交顺序收回结果已可用的槽，CPU 从不等待 GPU：
+ *  结果通常落后 2 ~ 3 帧，环满时（GPU 落后超过 kRing 帧）丢弃最早一帧的结果
+ *  每个槽的查询对象按需增加，之后复用
+ * 所有函数都需要当前线程有 OpenGL 上下文
+ */
+class GPU_StageTimer {
+public:
+	static constexpr int kRing = 3;
+	static constexpr int kWindow = 240; // 滚动统计的样本数
+
+	// 一步的各阶段耗时（秒）
+	struct Frame {
+		uint64_t step = 0;
+		std::array<double, static_cast<int>(GPU_Stage::Count)> seconds{};
+		std::array<bool, static_cast<int>(GPU_Stage::Count)> ran{};
+
+		[[nodiscard]] PhaseTimings phases() const; // 按 StepStats 的五个阶段合并
+	};
+
+	GPU_StageTimer() = default;
+	~GPU_StageTimer();
+	GPU_StageTimer(const GPU_StageTimer&) = delete;
+	GPU_StageTimer& operator=(const GPU_StageTimer&) = delete;
+
+	void beginFrame(uint64_t step); // 收回已完成的帧并写入第一个时间戳
+	void mark(GPU_Stage stage);     // 在上一次派发之后写入时间戳，耗时计入 stage
+	void endFrame();
+	void poll(); // 按提交顺序收回结果已可用的槽（beginFrame 中也会调用），不会等待
+
+	[[nodiscard]] GPU_StageSummary summary(GPU_Stage stage) const;
+	// 最近收回的几帧中 step 对应的一帧，已经丢弃或尚未完成时返回 nullptr
+	[[nodiscard]] const Frame* find(uint64_t step) const;
+	[[nodiscard]] uint64_t droppedFrames() const { return dropped; }
+	void reset(); // 清空滚动统计，例如跳过预热步
+
+private:
+	struct Slot {
+		std::vector<GLuint> queries;
+		std::vector<GPU_Stage> labels; // labels[k] 为 queries[k] 之前一段的阶段，labels[0] 不使用
+		int used = 0;
+		uint64_t step = 0;
+		bool pending = false;
+	};
+	struct Window {
+		std::array<double, kWindow> samples{};
+		int size = 0;
+		int head = 0;
+	};
+
+	void resolve(Slot& slot);
+
+	std::array<Slot, kRing> slots;
+	int head = 0;                 // 下一个写入的槽，也是最早提交的槽
+	Slot* current = nullptr;      // beginFrame 与 endFrame 之间正在写入的槽
+	std::array<Window, static_cast<int>(GPU_Stage::Count)> windows;
+	std::array<Frame, 2 * kRing> recent; // 最近收回的帧
+	int recentHead = 0;
+	int recentCount = 0;
+	uint64_t dropped = 0;
+};
+
+#endif //LEARNOPENGL_GPU_STAGETIMER_H
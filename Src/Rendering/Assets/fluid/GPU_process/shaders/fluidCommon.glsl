@@ -115,15 +115,16 @@ const float PI = 3.14159265358979323846;
 const float POLY6_COEFF   = 315.0 / (64.0 * PI);  // 只是常数部分，h 相关单独算
 const float SPIKY_COEFF   = -45.0 / PI;
 
-uint hash(uint x) {
-    x = ((x >> 16) ^ x) * 0x45d9f3bu;
-    x = ((x >> 16) ^ x) * 0x45d9f3bu;
-    x = (x >> 16) ^ x;
-    return x;
-}
-
-float rand(uint seed) {
-    return float(hash(seed)) / float(0xffffffffu);
+// 计数器随机数 Philox4x32-10，与 C++ 的 Utils/CounterRNG.h 逐位一致
+uvec4 philox4x32(uvec4 ctr, uvec2 key) {
+    for (int round = 0; round < 10; ++round) {
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(0xD2511F53u, ctr.x, hi0, lo0);
+        umulExtended(0xCD9E8D57u, ctr.z, hi1, lo1);
+        ctr = uvec4(hi1 ^ ctr.y ^ key.x, lo1, hi0 ^ ctr.w ^ key.y, lo0);
+        key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return ctr;
 }
 
 layout(std140, binding = 0) uniform SimParams {
@@ -133,8 +134,10 @@ layout(std140, binding = 0) uniform SimParams {
     float rho;
     float neighbourRadius;
     float lambdaEpsilon;
+    uint seed;         // 随机数种子
+    uint stepIndex;    // 已执行的步数（step 与内置函数重名）
 
-    ivec3 gridSize;
+    ivec3 gridSize;    // 网格改为哈希表后不再决定存储大小，只保留布局
     float cellSize;
 
     vec3 boundaryMin;  // 一般是 (0,0,0)
@@ -142,30 +145,57 @@ layout(std140, binding = 0) uniform SimParams {
     vec3 boundaryMax;  // 对应你 Simulator::boundary
     float _pad1;
 
-    int maxNeighboursPerCell; // 每个 cell 能装多少粒子
+    int maxNeighboursPerCell; // 网格改为紧凑的单元列表后不再使用，只保留布局
     int numParticles;         // 粒子总数
     int pbfNumIters;          // PBF 迭代次数
-    int _pad2;
+    uint cellTableSize;       // 网格哈希表的槽数（2 的幂）
+
+    float xsphViscosity;      // XSPH 系数 c，0 表示关闭
+    float vorticityEpsilon;   // 涡量约束系数 ε，0 表示关闭
+    uint pairCacheCapacity;   // 邻居对缓存每个粒子的容量，0 表示关闭
+    float _pad3;
+
+    float scorrK;             // 人工压力 scorr = scorrK * (W(r) * invRefPoly6)^4
+    float invRefPoly6;        // 1 / W(Δq)，0 表示关闭人工压力
+    float _pad4;
+    float _pad5;
+};
+
+// [0, 1) 内的 4 个均匀分布随机数，计数器为 (粒子编号, 步数, 用途, 0)，与 crng::uniform4 一致
+vec4 rand4(uint index, uint stream) {
+    uvec4 bits = philox4x32(uvec4(index, stepIndex, stream, 0u), uvec2(seed, 0u));
+    return vec4(bits >> 8u) * (1.0 / 16777216.0);
+}
+
+// 粒子按访问频率拆成四个 SSBO（与 GPU_Particle.h 的 gpustream 一致，每项 16 字节）
+// 邻居遍历只读 posLambda，速度、旧位置与其他属性只在本粒子或粘性涡量 pass 中读取
+layout(std430, binding = 1) buffer ParticlePosLambda {
+    vec4 posLambda[];    // xyz: 预测位置, w: 拉格朗日乘子 λ
+};
+
+layout(std430, binding = 12) buffer ParticleVelocity {
+    vec4 velocity[];     // xyz: 速度, w: 本步的涡量大小 |ω|（csViscosityVorticity 写入）
 };
 
-// 粒子结构（在 C++ 里要按 std430 对齐规则来写内存）
-struct Particle {
-    vec4 pos;      // xyz: 位置, w 可以不用
-    vec4 vel;      // xyz: 速度
-    vec4 oldPos;   // xyz: 上一帧位置
-    float lambda;
-    float density;
-    float _padA;
-    float _padB;
+layout(std430, binding = 13) buffer ParticleOldPos {
+    vec4 oldPosition[];  // xyz: 上一帧位置, w: 上一步的 |ω|（csPredictAndBuildGrid 从 velocity.w 拷贝）
 };
 
-// 粒子数组 SSBO
-layout(std430, binding = 1) buffer Particles {
-    Particle particles[];
+struct ParticleAux {
+    float density;    // 密度约束 C = ρ/ρ0 - 1
+    float neighbours; // 最后一次 lambda 计算时的邻居数（统计用）
+    uint id;          // 粒子编号，按网格重排（csReorderParticles）时随粒子移动
+    float _pad;
+};
+
+layout(std430, binding = 14) buffer ParticleAuxBuffer {
+    ParticleAux particleAux[];
 };
 
 // 每个 cell 装的是“粒子索引”，而不是指针
-// cellParticleIndices 的长度 = gridSize.x * gridSize.y * gridSize.z * maxNeighboursPerCell
+// cell 按坐标哈希到 cellTableSize 个槽中，不同 cell 可能落在同一个槽里，遍历槽内粒子时按距离过滤
+// 紧凑的单元列表（计数 -> 前缀和 -> 分散写入）：槽 s 内的粒子为
+// cellParticleIndices[cellStart[s], cellStart[s] + cellCounts[s])，按槽排序，共 numParticles 项，不会溢出
 layout(std430, binding = 2) buffer CellParticleIndices {
     uint cellParticleIndices[];
 };
@@ -175,6 +205,51 @@ layout(std430, binding = 3) buffer CellCounts {
     uint cellCounts[];
 };
 
+// cellCounts 的排他前缀和（csScanCells / csScanBlockSums / csScanAdd）
+layout(std430, binding = 8) buffer CellStart {
+    uint cellStart[];
+};
+
+// 粒子在所属槽内的序号，即 csPredictAndBuildGrid 中 atomicAdd 的返回值
+layout(std430, binding = 9) buffer ParticleCellRank {
+    uint particleRank[];
+};
+
+// 按网格分块的邻居遍历（neighbourTiles.glsl）的任务列表：csClearGrid 清零，csBuildCellTiles 追加非空槽
+const uint MAX_TILE_GROUPS = 65535u; // GL_MAX_COMPUTE_WORK_GROUP_COUNT 保证的最小值，非空槽更多时工作组循环处理
+layout(std430, binding = 18) buffer CellTiles {
+    uint tileDispatch[3]; // glDispatchComputeIndirect 的参数：(min(tileCount, MAX_TILE_GROUPS), 1, 1)
+    uint tileCount;       // 非空槽数
+    uint tileSlots[];     // 非空槽，顺序由原子操作决定
+};
+
+// 每步的统计（对应 C++ 的 GPUStepStats），csClearGrid 清零，csGridStats / csParticleStats 按工作组归约后累加
+const int STATS_NEIGHBOUR_BINS = 16;       // 与 StepStats::kNeighbourBins 一致
+const uint STATS_NEIGHBOUR_BIN_WIDTH = 4u; // 与 StepStats::kNeighbourBinWidth 一致
+const float STATS_DENSITY_ERROR_SCALE = 64.0; // 密度误差之和按定点数累加
+const float STATS_DENSITY_ERROR_CLAMP = 16.0; // 累加前截断，避免定点数溢出
+layout(std430, binding = 4) buffer StepStatsBuffer {
+    uint statsCellOverflows;    // 紧凑的单元列表不会溢出，始终为 0，保留给报告格式
+    uint statsOccupiedCells;    // 非空槽数
+    uint statsMaxCellOccupancy; // 单个槽内的最大粒子数
+    uint statsDensityErrorMax;  // float 的位模式，非负 float 按 uint 比较时顺序不变
+    uint statsDensityErrorSum;  // 定点数，乘以 STATS_DENSITY_ERROR_SCALE
+    uint _statsPad0;
+    uint _statsPad1;
+    uint _statsPad2;
+    uint statsNeighbourHistogram[STATS_NEIGHBOUR_BINS];
+};
+
+// 邻居对缓存：csComputeLambda 写入每个粒子前 pairCacheCapacity 个邻居的 ∇W 与 scorr，
+// 同一次迭代的 csComputeDeltaAndApply 直接读取；第 k 个邻居存在 k * numParticles + i，相邻线程的访问连续
+// 邻居数超过容量的粒子在 csComputeDeltaAndApply 中照常遍历网格
+layout(std430, binding = 5) buffer PairCache {
+    vec4 pairGrad[];      // xyz: ∇W, w: scorr
+};
+layout(std430, binding = 6) buffer PairNeighbours {
+    uint pairNeighbour[]; // 邻居粒子的下标
+};
+
 // 工具函数：世界坐标 -> cell 坐标
 ivec3 getCell(vec3 pos) {
     return ivec3(
@@ -184,14 +259,28 @@ ivec3 getCell(vec3 pos) {
     );
 }
 
-bool isInRange(ivec3 c) {
-    return  c.x >= 0 && c.x < gridSize.x &&
-    c.y >= 0 && c.y < gridSize.y &&
-    c.z >= 0 && c.z < gridSize.z;
+// 32 位网格哈希，与 CPU 的 cellhash::hashCell() 逐位一致
+uint hashCell(ivec3 c) {
+    uint h = uint(c.x) * 0x8da6b343u ^ uint(c.y) * 0xd8163841u ^ uint(c.z) * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
 }
 
+// cell 坐标 -> 哈希表槽，内存只与槽数有关，与场景包围盒无关
 uint cellToIndex(ivec3 c) {
-    return uint(c.z + gridSize.z * (c.y + gridSize.y * c.x));
+    return hashCell(c) & (cellTableSize - 1u);
+}
+
+// slots[0, count) 中是否已经出现过 slot（邻居 cell 之间的哈希冲突）
+bool slotVisited(uint slots[27], int count, uint slot) {
+    for (int k = 0; k < count; ++k) {
+        if (slots[k] == slot) return true;
+    }
+    return false;
 }
 
 // Poly6 核
@@ -0,0 +1,55 @@
+// 按网格分块的邻居遍历，csComputeLambdaTiled / csComputeDeltaAndApplyTiled 共用
+// 每个工作组依次处理 tileSlots 中的非空槽，槽内粒子每 TILE_SIZE 个为一批，每个调用一个粒子：
+// 以本批第一个粒子的 cell 为中心遍历 27 个邻居槽，槽内粒子分批协作读入共享内存后再计算核函数，
+// 同一批邻居只从全局内存读一次（逐粒子版本中同一 cell 的每个粒子都要各读一遍）
+// 与中心 cell 不同的粒子（哈希冲突，或迭代中移出了建网格时的 cell）照常遍历全局内存，结果不变
+// 使用的函数都含有 barrier，必须在统一控制流中调用
+
+const uint TILE_SIZE = 64u; // 工作组大小，也是每批读入共享内存的邻居数
+
+// 预定义 27 个邻居偏移，与逐粒子版本的遍历顺序一致
+const ivec3 NEIGHBOR_OFFSETS[27] = ivec3[27](
+ivec3(-1,-1,-1), ivec3(0,-1,-1), ivec3(1,-1,-1),
+ivec3(-1, 0,-1), ivec3(0, 0,-1), ivec3(1, 0,-1),
+ivec3(-1, 1,-1), ivec3(0, 1,-1), ivec3(1, 1,-1),
+
+ivec3(-1,-1, 0), ivec3(0,-1, 0), ivec3(1,-1, 0),
+ivec3(-1, 0, 0), ivec3(0, 0, 0), ivec3(1, 0, 0),
+ivec3(-1, 1, 0), ivec3(0, 1, 0), ivec3(1, 1, 0),
+
+ivec3(-1,-1, 1), ivec3(0,-1, 1), ivec3(1,-1, 1),
+ivec3(-1, 0, 1), ivec3(0, 0, 1), ivec3(1, 0, 1),
+ivec3(-1, 1, 1), ivec3(0, 1, 1), ivec3(1, 1, 1)
+);
+
+shared vec4 tilePos[TILE_SIZE];   // 本批邻居的 posLambda
+shared uint tileIndex[TILE_SIZE]; // 本批邻居的下标
+shared ivec3 tileHomeCell;        // 本批本地粒子的中心 cell
+shared uint tileUsers;            // 走共享内存路径的调用数，为 0 时整个工作组跳过分批读取
+
+// 开始处理一批本地粒子：调用 0（本批一定有效）的 cell 作为中心 cell，返回本调用是否走共享内存路径
+bool beginHomeBatch(ivec3 cell, bool candidate) {
+    barrier(); // 上一批的 tileHomeCell / tileUsers 已经用完
+    if (gl_LocalInvocationIndex == 0u) {
+        tileHomeCell = cell;
+        tileUsers = 0u;
+    }
+    barrier();
+    bool tiled = candidate && all(equal(cell, tileHomeCell));
+    if (tiled) atomicAdd(tileUsers, 1u);
+    barrier();
+    return tiled;
+}
+
+// 协作读入槽内第 [first, first + TILE_SIZE) 个粒子，返回本批的个数
+uint stageNeighbours(uint base, uint count, uint first) {
+    barrier(); // 上一批邻居已经用完
+    uint k = first + gl_LocalInvocationIndex;
+    if (k < count) {
+        uint j = cellParticleIndices[base + k];
+        tileIndex[gl_LocalInvocationIndex] = j;
+        tilePos[gl_LocalInvocationIndex] = posLambda[j];
+    }
+    barrier();
+    return min(TILE_SIZE, count - first);
+}
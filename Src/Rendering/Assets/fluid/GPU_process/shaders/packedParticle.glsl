@@ -0,0 +1,28 @@
+// 紧凑粒子格式的 GLSL 编码 / 解码，与 PackedParticles.h 的 packed::encode / decode 使用相同的公式与舍入
+// 每个粒子两个 32 位字：x = qx | qy << 16，y = qz | scalar << 16（scalar 为 8 位，高 8 位保留为 0）
+// 位置相对于包围盒量化为 16 位，scalar 在 scalarRange = (min, max) 内量化为 8 位
+
+uint quantiseUnorm(float v, float lo, float hi, float levels) {
+    float extent = max(hi - lo, 1e-6);
+    return uint(roundEven(clamp((v - lo) * (levels / extent), 0.0, levels)));
+}
+
+float dequantiseUnorm(uint q, float lo, float hi, float levels) {
+    float extent = max(hi - lo, 1e-6);
+    return lo + float(q) * (extent / levels);
+}
+
+uvec2 packParticle(vec3 pos, float scalar, vec3 aabbMin, vec3 aabbMax, vec2 scalarRange) {
+    uint qx = quantiseUnorm(pos.x, aabbMin.x, aabbMax.x, 65535.0);
+    uint qy = quantiseUnorm(pos.y, aabbMin.y, aabbMax.y, 65535.0);
+    uint qz = quantiseUnorm(pos.z, aabbMin.z, aabbMax.z, 65535.0);
+    uint qs = quantiseUnorm(scalar, scalarRange.x, scalarRange.y, 255.0);
+    return uvec2(qx | (qy << 16), qz | (qs << 16));
+}
+
+void unpackParticle(uvec2 w, vec3 aabbMin, vec3 aabbMax, vec2 scalarRange, out vec3 pos, out float scalar) {
+    pos.x = dequantiseUnorm(w.x & 0xffffu, aabbMin.x, aabbMax.x, 65535.0);
+    pos.y = dequantiseUnorm(w.x >> 16, aabbMin.y, aabbMax.y, 65535.0);
+    pos.z = dequantiseUnorm(w.y & 0xffffu, aabbMin.z, aabbMax.z, 65535.0);
+    scalar = dequantiseUnorm((w.y >> 16) & 0xffu, scalarRange.x, scalarRange.y, 255.0);
+}
@@ -0,0 +1,29 @@
+// 并行排他前缀和：每个工作组 SCAN_THREADS 个调用，每个调用连续 SCAN_ITEMS 个元素，
+// 一个工作组处理 SCAN_BLOCK 个元素；各块的和写入 scanBlockSums，再由单个工作组扫描后加回
+const uint SCAN_THREADS = 256u;
+const uint SCAN_ITEMS = 4u;
+const uint SCAN_BLOCK = SCAN_THREADS * SCAN_ITEMS;
+
+layout(std430, binding = 10) buffer ScanBlockSums {
+    uint scanBlockSums[];
+};
+
+shared uint scanShared[SCAN_THREADS];
+
+// 工作组内的排他前缀和，total 为整个工作组的和；工作组内所有调用都必须执行到
+uint workgroupExclusiveScan(uint value, out uint total) {
+    uint lid = gl_LocalInvocationIndex;
+    scanShared[lid] = value;
+    barrier();
+    // Hillis-Steele 包含扫描，log2(256) = 8 轮
+    for (uint offset = 1u; offset < SCAN_THREADS; offset <<= 1) {
+        uint add = lid >= offset ? scanShared[lid - offset] : 0u;
+        barrier();
+        scanShared[lid] += add;
+        barrier();
+    }
+    total = scanShared[SCAN_THREADS - 1u];
+    uint exclusive = scanShared[lid] - value;
+    barrier(); // 再次调用前所有调用都已读完 scanShared
+    return exclusive;
+}
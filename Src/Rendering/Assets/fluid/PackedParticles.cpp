@@ -0,0 +1,189 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "PackedParticles.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define PACKED_SIMD_X86 1
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#define PACKED_TARGET_AVX2
+	#else
+		#define PACKED_TARGET_AVX2 __attribute__((target("avx2,fma")))
+	#endif
+#endif
+
+namespace packed {
+
+namespace {
+
+constexpr float kLevels16 = 65535.0f;
+constexpr float kLevels8 = 255.0f;
+
+// 一个通道的量化参数：q = (v - lo) * scale，v = lo + q * step
+struct Channel {
+	float lo = 0.0f, scale = 0.0f, step = 0.0f;
+
+	Channel(float lo, float hi, float levels) : lo(lo) {
+		const float extent = std::max(hi - lo, 1e-6f);
+		scale = levels / extent;
+		step = extent / levels;
+	}
+};
+
+// max(0, t) 在 t 为 NaN 时返回 0
+// 加上 1.5 * 2^23 后尾数的低位即为按默认舍入模式（就近取偶）舍入的结果，与 cvtps 和 GLSL 的 roundEven 一致，
+// 比 lrint 的函数调用快一个数量级
+inline uint32_t quantise(float v, const Channel& c, float levels) {
+	const float t = std::min(std::max(0.0f, (v - c.lo) * c.scale), levels);
+	return std::bit_cast<uint32_t>(t + 0x1.8p23f) - 0x4b400000u;
+}
+
+bool useAVX2(sph::SimdLevel maxLevel) {
+	static const sph::SimdLevel supported = sph::detectSimdLevel();
+	return static_cast<int>(maxLevel) >= static_cast<int>(sph::SimdLevel::AVX2) &&
+	       static_cast<int>(supported) >= static_cast<int>(sph::SimdLevel::AVX2);
+}
+
+// ----------- 标量实现（也用于 SIMD 实现的尾部） -----------
+void quantise16Scalar(const float* src, std::size_t begin, std::size_t n, const Channel& c, uint16_t* dst) {
+	for (std::size_t i = begin; i < n; i++) {
+		dst[i] = static_cast<uint16_t>(quantise(src[i], c, kLevels16));
+	}
+}
+
+void encodeScalar(const float* x, const float* y, const float* z, const float* scalar, std::size_t begin,
+                  std::size_t n, const Channel (&c)[4], PackedParticle* out) {
+	for (std::size_t i = begin; i < n; i++) {
+		out[i].x = static_cast<uint16_t>(quantise(x[i], c[0], kLevels16));
+		out[i].y = static_cast<uint16_t>(quantise(y[i], c[1], kLevels16));
+		out[i].z = static_cast<uint16_t>(quantise(z[i], c[2], kLevels16));
+		out[i].scalar = scalar ? static_cast<uint8_t>(quantise(scalar[i], c[3], kLevels8)) : 0;
+		out[i]._pad = 0;
+	}
+}
+
+void decodeScalar(const PackedParticle* in, std::size_t begin, std::size_t n, const Channel (&c)[4], float* x,
+                  float* y, float* z, float* scalar) {
+	for (std::size_t i = begin; i < n; i++) {
+		x[i] = c[0].lo + static_cast<float>(in[i].x) * c[0].step;
+		y[i] = c[1].lo + static_cast<float>(in[i].y) * c[1].step;
+		z[i] = c[2].lo + static_cast<float>(in[i].z) * c[2].step;
+		if (scalar) scalar[i] = c[3].lo + static_cast<float>(in[i].scalar) * c[3].step;
+	}
+}
+
+// ----------- AVX2：一次 8 个粒子 -----------
+#ifdef PACKED_SIMD_X86
+
+PACKED_TARGET_AVX2 inline __m256i quantise8(__m256 v, const Channel& c, float levels) {
+	const __m256 t = _mm256_mul_ps(_mm256_sub_ps(v, _mm256_set1_ps(c.lo)), _mm256_set1_ps(c.scale));
+	// max_ps 的任一操作数为 NaN 时返回第二个操作数，即 0
+	return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(t, _mm256_setzero_ps()), _mm256_set1_ps(levels)));
+}
+
+PACKED_TARGET_AVX2 inline void dequantise8(float* dst, __m256i q, const Channel& c) {
+	_mm256_storeu_ps(dst, _mm256_fmadd_ps(_mm256_cvtepi32_ps(q), _mm256_set1_ps(c.step), _mm256_set1_ps(c.lo)));
+}
+
+PACKED_TARGET_AVX2 void quantise16AVX2(const float* src, std::size_t n, const Channel& c, uint16_t* dst) {
+	std::size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		const __m256i a = quantise8(_mm256_loadu_ps(src + i), c, kLevels16);
+		const __m256i b = quantise8(_mm256_loadu_ps(src + i + 8), c, kLevels16);
+		// packus 在每个 128 位通道内交错 a、b，再按 64 位重新排列成 a0..a7 b0..b7
+		const __m256i q = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), q);
+	}
+	quantise16Scalar(src, i, n, c, dst);
+}
+
+PACKED_TARGET_AVX2 void encodeAVX2(const float* x, const float* y, const float* z, const float* scalar, std::size_t n,
+                                   const Channel (&c)[4], PackedParticle* out) {
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		const __m256i qx = quantise8(_mm256_loadu_ps(x + i), c[0], kLevels16);
+		const __m256i qy = quantise8(_mm256_loadu_ps(y + i), c[1], kLevels16);
+		const __m256i qz = quantise8(_mm256_loadu_ps(z + i), c[2], kLevels16);
+		const __m256i qs = scalar ? quantise8(_mm256_loadu_ps(scalar + i), c[3], kLevels8) : _mm256_setzero_si256();
+		// 每个粒子的两个 32 位字：lo = x | y << 16，hi = z | scalar << 16
+		const __m256i lo = _mm256_or_si256(qx, _mm256_slli_epi32(qy, 16));
+		const __m256i hi = _mm256_or_si256(qz, _mm256_slli_epi32(qs, 16));
+		// unpack 在 128 位通道内交错：a 为粒子 0 1 | 4 5，b 为 2 3 | 6 7
+		const __m256i a = _mm256_unpacklo_epi32(lo, hi);
+		const __m256i b = _mm256_unpackhi_epi32(lo, hi);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute2x128_si256(a, b, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i + 4), _mm256_permute2x128_si256(a, b, 0x31));
+	}
+	encodeScalar(x, y, z, scalar, i, n, c, out);
+}
+
+PACKED_TARGET_AVX2 void decodeAVX2(const PackedParticle* in, std::size_t n, const Channel (&c)[4], float* x, float* y,
+                                   float* z, float* scalar) {
+	const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+	const __m256i low16 = _mm256_set1_epi32(0xffff);
+	std::size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		// 每个 256 位读入 4 个粒子，先在寄存器内把 lo / hi 字分开，再拼成 8 个粒子的 lo 与 hi
+		const __m256i p0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), split);
+		const __m256i p1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 4)), split);
+		const __m256i lo = _mm256_permute2x128_si256(p0, p1, 0x20);
+		const __m256i hi = _mm256_permute2x128_si256(p0, p1, 0x31);
+		dequantise8(x + i, _mm256_and_si256(lo, low16), c[0]);
+		dequantise8(y + i, _mm256_srli_epi32(lo, 16), c[1]);
+		dequantise8(z + i, _mm256_and_si256(hi, low16), c[2]);
+		if (scalar) dequantise8(scalar + i, _mm256_and_si256(_mm256_srli_epi32(hi, 16), _mm256_set1_epi32(0xff)), c[3]);
+	}
+	decodeScalar(in, i, n, c, x, y, z, scalar);
+}
+
+#endif
+
+} // namespace
+
+void quantise16(const float* src, std::size_t n, float lo, float hi, uint16_t* dst, sph::SimdLevel maxLevel) {
+	const Channel c(lo, hi, kLevels16);
+#ifdef PACKED_SIMD_X86
+	if (useAVX2(maxLevel)) {
+		quantise16AVX2(src, n, c, dst);
+		return;
+	}
+#endif
+	quantise16Scalar(src, 0, n, c, dst);
+}
+
+void encode(const float* x, const float* y, const float* z, const float* scalar, std::size_t n, const Range& range,
+            PackedParticle* out, sph::SimdLevel maxLevel) {
+	const Channel c[4] = {Channel(range.aabbMin[0], range.aabbMax[0], kLevels16),
+	                      Channel(range.aabbMin[1], range.aabbMax[1], kLevels16),
+	                      Channel(range.aabbMin[2], range.aabbMax[2], kLevels16),
+	                      Channel(range.scalarMin, range.scalarMax, kLevels8)};
+#ifdef PACKED_SIMD_X86
+	if (useAVX2(maxLevel)) {
+		encodeAVX2(x, y, z, scalar, n, c, out);
+		return;
+	}
+#endif
+	encodeScalar(x, y, z, scalar, 0, n, c, out);
+}
+
+void decode(const PackedParticle* in, std::size_t n, const Range& range, float* x, float* y, float* z, float* scalar,
+            sph::SimdLevel maxLevel) {
+	const Channel c[4] = {Channel(range.aabbMin[0], range.aabbMax[0], kLevels16),
+	                      Channel(range.aabbMin[1], range.aabbMax[1], kLevels16),
+	                      Channel(range.aabbMin[2], range.aabbMax[2], kLevels16),
+	                      Channel(range.scalarMin, range.scalarMax, kLevels8)};
+#ifdef PACKED_SIMD_X86
+	if (useAVX2(maxLevel)) {
+		decodeAVX2(in, n, c, x, y, z, scalar);
+		return;
+	}
+#endif
+	decodeScalar(in, 0, n, c, x, y, z, scalar);
+}
+
+} // namespace packed
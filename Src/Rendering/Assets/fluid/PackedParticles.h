@@ -0,0 +1,65 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_PACKEDPARTICLES_H
+#define LEARNOPENGL_PACKEDPARTICLES_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "Rendering/Assets/fluid/CPU_process/SPHKernelsSIMD.h"
+
+/*
+ * 渲染上传与传输用的紧凑粒子格式，8 字节 / 粒子（Vertex 为 48 字节，GPU_Particle 为 64 字节）
+ *  x, y, z：相对于包围盒的 16 位定点数，q = roundEven(clamp((v - min) * 65535 / (max - min), 0, 65535))
+ *  scalar：同样方式量化到 8 位的着色通道（密度或速率），区间由调用方给出
+ *  最后一个字节保留为 0
+ * 位置精度为包围盒边长 / 65535，包围盒外的粒子被截断到边界上；NaN 编码为 0
+ * 编码与量化有标量 / AVX2 实现（只受内存带宽限制，AVX-512 没有额外收益），
+ * GLSL 的 packParticle / unpackParticle（GPU_process/shaders/packedParticle.glsl）使用相同的公式与舍入
+ */
+namespace packed {
+
+struct PackedParticle {
+	uint16_t x, y, z;
+	uint8_t scalar;
+	uint8_t _pad;
+};
+static_assert(sizeof(PackedParticle) == 8);
+
+// 量化区间；GLSL 端的 uniform / UBO 使用相同的字段
+struct Range {
+	float aabbMin[3] = {};
+	float aabbMax[3] = {};
+	float scalarMin = 0.0f;
+	float scalarMax = 1.0f;
+};
+
+// 16 位定点数：dst[i] = roundEven(clamp((src[i] - lo) * 65535 / (hi - lo), 0, 65535))
+void quantise16(const float* src, std::size_t n, float lo, float hi, uint16_t* dst,
+                sph::SimdLevel maxLevel = sph::SimdLevel::AVX512);
+// SoA -> 紧凑格式；scalar 为 nullptr 时着色通道写 0
+void encode(const float* x, const float* y, const float* z, const float* scalar, std::size_t n, const Range& range,
+            PackedParticle* out, sph::SimdLevel maxLevel = sph::SimdLevel::AVX512);
+// 紧凑格式 -> SoA：v = min + q * (max - min) / 65535，scalar 为 nullptr 时跳过
+void decode(const PackedParticle* in, std::size_t n, const Range& range, float* x, float* y, float* z, float* scalar,
+            sph::SimdLevel maxLevel = sph::SimdLevel::AVX512);
+
+// IEEE 半精度 -> float，用于解码 GLSL packHalf2x16 写入的通道（GPU 紧凑回读中的速度）
+inline float halfToFloat(uint16_t h) {
+	const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+	const uint32_t exponent = (h >> 10) & 0x1fu;
+	const uint32_t mantissa = h & 0x3ffu;
+	if (exponent == 0x1f) return std::bit_cast<float>(sign | 0x7f800000u | mantissa << 13); // inf / NaN
+	if (exponent == 0) {
+		const float m = static_cast<float>(mantissa) * 0x1p-24f; // 非规格化数与 0
+		return sign ? -m : m;
+	}
+	return std::bit_cast<float>(sign | (exponent + 112u) << 23 | mantissa << 13);
+}
+
+} // namespace packed
+
+#endif //LEARNOPENGL_PACKEDPARTICLES_H
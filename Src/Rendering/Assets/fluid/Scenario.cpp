@@ -0,0 +1,77 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#include "Scenario.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "Utils/CounterRNG.h"
+
+namespace scenario {
+
+const char* layoutName(Layout layout) {
+	switch (layout) {
+		case Layout::Cube: return "cube";
+		case Layout::DamBreak: return "dambreak";
+		case Layout::Pool: return "pool";
+	}
+	return "unknown";
+}
+
+bool parseLayout(const std::string& name, Layout& layout) {
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+	for (Layout l : {Layout::Cube, Layout::DamBreak, Layout::Pool}) {
+		if (lower == layoutName(l)) {
+			layout = l;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<Eigen::Vector3f> generate(Layout layout, int particleNums, const Eigen::Vector3f& boundaryMin,
+                                      const Eigen::Vector3f& boundaryMax, uint32_t seed, float spacing) {
+	const Eigen::Vector3f extent = boundaryMax - boundaryMin;
+	// 每层的行列数与第一个粒子的位置
+	int numPerRow = 1, numPerCol = 1;
+	Eigen::Vector3f origin = boundaryMin + Eigen::Vector3f::Constant(0.5f * spacing);
+	const auto fit = [spacing](float length) { return std::max(1, static_cast<int>(length / spacing)); };
+	switch (layout) {
+		case Layout::Cube: {
+			numPerRow = numPerCol = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(std::max(particleNums, 1)))));
+			const float side = static_cast<float>(numPerRow) * spacing;
+			origin.x() = boundaryMin.x() + std::max(0.5f * (extent.x() - side), 0.5f * spacing);
+			origin.z() = boundaryMin.z() + std::max(0.5f * (extent.z() - side), 0.5f * spacing);
+			origin.y() = boundaryMin.y() + 2.0f;
+			break;
+		}
+		case Layout::DamBreak:
+			numPerRow = fit(0.5f * extent.x() - spacing);
+			numPerCol = fit(extent.z() - spacing);
+			break;
+		case Layout::Pool:
+			numPerRow = fit(extent.x() - spacing);
+			numPerCol = fit(extent.z() - spacing);
+			break;
+	}
+
+	std::vector<Eigen::Vector3f> positions;
+	positions.reserve(std::max(particleNums, 0));
+	const int numPerFloor = numPerRow * numPerCol;
+	for (int i = 0; i < particleNums; i++) {
+		const int floor = i / numPerFloor;
+		const int row = (i % numPerFloor) / numPerRow;
+		const int col = (i % numPerFloor) % numPerRow;
+		const auto r = crng::uniform4(static_cast<uint32_t>(i), 0u, crng::kStreamInit, seed);
+		const Eigen::Vector3f jitter = (Eigen::Vector3f(r[0], r[1], r[2]) - Eigen::Vector3f::Constant(0.5f)) * 0.5f * spacing;
+		positions.emplace_back(origin + Eigen::Vector3f(static_cast<float>(col), static_cast<float>(floor),
+		                                                static_cast<float>(row)) * spacing + jitter);
+	}
+	return positions;
+}
+
+} // namespace scenario
@@ -0,0 +1,42 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_SCENARIO_H
+#define LEARNOPENGL_SCENARIO_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef __unix__
+	#include <eigen3/Eigen/Eigen>
+#elif _WIN32
+	#include <Eigen/Eigen>
+#endif
+
+/*
+ * 流体初始场景，CPU 与 GPU 求解器、批处理程序与基准测试共用
+ *  粒子放在间距为 spacing 的晶格上，加 ±spacing / 4 的抖动（由粒子编号与种子决定，见 Utils/CounterRNG.h）
+ *  Cube：边长 ceil(cbrt(n)) 的立方体，x / z 居中，离底面 2 个单位
+ *  DamBreak：溃坝，靠 x 负方向一侧、占一半宽度的水柱
+ *  Pool：铺满整个底面的水池，逐层向上堆叠
+ *  粒子数超过包围盒能容纳的数量时继续向上堆叠，由求解器的边界处理约束
+ */
+namespace scenario {
+
+enum class Layout {
+	Cube,
+	DamBreak,
+	Pool,
+};
+
+const char* layoutName(Layout layout);
+bool parseLayout(const std::string& name, Layout& layout); // 名称不区分大小写，无法识别时返回 false
+
+std::vector<Eigen::Vector3f> generate(Layout layout, int particleNums, const Eigen::Vector3f& boundaryMin,
+                                      const Eigen::Vector3f& boundaryMax, uint32_t seed, float spacing = 1.0f);
+
+} // namespace scenario
+
+#endif //LEARNOPENGL_SCENARIO_H
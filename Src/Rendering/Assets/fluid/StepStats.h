@@ -0,0 +1,61 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_STEPSTATS_H
+#define LEARNOPENGL_STEPSTATS_H
+
+#include <array>
+#include <cstdint>
+
+// 各阶段耗时（秒）；累计值或单个子步的值
+struct PhaseTimings {
+	double reorder = 0.0;  // Z 序重排
+	double prologue = 0.0; // 预测位置、网格与邻居表
+	double lambda = 0.0;   // 全部 computeLambda
+	double delta = 0.0;    // 全部 applyDelta（含热启动）
+	double epilogue = 0.0; // 速度更新与边界处理
+	uint64_t steps = 0;    // 累计的子步数
+
+	PhaseTimings& operator+=(const PhaseTimings& rhs) {
+		reorder += rhs.reorder;
+		prologue += rhs.prologue;
+		lambda += rhs.lambda;
+		delta += rhs.delta;
+		epilogue += rhs.epilogue;
+		steps += rhs.steps;
+		return *this;
+	}
+	[[nodiscard]] double total() const { return reorder + prologue + lambda + delta + epilogue; }
+};
+
+/*
+ * 单个子步的求解器统计，CPU 与 GPU 求解器共用
+ *  CPU：在已有的串行前缀和循环中顺带统计，不增加额外的遍历；邻居表复用（Verlet skin）的步保留上次构建时的邻居与网格统计
+ *  GPU：两个归约 pass 写入统计 SSBO，经 fence 异步回读，读到的是几帧之前的一步（见 step）；
+ *       phases 来自同一步的时间戳查询，两者各自异步收回后按步数对应
+ */
+struct StepStats {
+	static constexpr int kNeighbourBins = 16;
+	static constexpr int kNeighbourBinWidth = 4; // 第 b 个桶统计邻居数在 [4b, 4b + 4) 内的粒子，最后一个桶包含更多的
+
+	uint64_t step = 0;          // 统计对应的步数（执行这一步之前的 stepCount / stepIndex）
+	PhaseTimings phases;        // 本子步各阶段耗时；GPU 为时间戳查询的结果（GPU_StageTimer），计时未完成时为 0
+	int iterations = 0;         // 实际执行的迭代次数
+	int warmStartPasses = 0;    // CPU：热启动额外执行的位置修正次数（0 或 1），本步位置修正共 iterations + warmStartPasses 次
+	float densityErrorMax = 0.0f; // 最后一次 lambda 计算时 max(ρ/ρ0 - 1, 0) 的最大值
+	float densityErrorAvg = 0.0f; // 同上，平均值
+	std::array<uint32_t, kNeighbourBins> neighbourHistogram{};
+	uint32_t truncatedParticles = 0; // CPU：邻居数达到上限的粒子数（邻居表可能被截断）
+	uint32_t droppedNeighbours = 0;  // CPU：超出上限没有写入邻居表的邻居数；成对遍历时 j > i 的邻居始终保留，只丢弃 j < i 的
+	uint32_t cellOverflows = 0;      // 没有写入网格的粒子数；CPU 与 GPU 的单元列表都不限容量，始终为 0，保留给报告格式
+	uint32_t occupiedCells = 0;      // 非空网格数（GPU 为非空槽数）
+	uint32_t maxCellOccupancy = 0;   // 单个网格内的最大粒子数（GPU 为单个槽）
+
+	static int neighbourBin(uint32_t count) {
+		const uint32_t bin = count / kNeighbourBinWidth;
+		return bin < kNeighbourBins ? static_cast<int>(bin) : kNeighbourBins - 1;
+	}
+};
+
+#endif //LEARNOPENGL_STEPSTATS_H
@@ -13,26 +13,32 @@ PointRender::PointRender(int particleNum, std::string vertexShaderPath, std::str
 	this->simulator = Simulator(particleNum);
 	this->m_vertexShaderPath = vertexShaderPath;
 	this->m_fragmentShaderPath = fragmentShaderPath;
-	this->vertices = std::vector<Vertex>(particleNum);
+	this->packedParticles = std::vector<packed::PackedParticle>(particleNum);
+	// 位置按模拟边界量化，着色通道为密度约束 ρ/ρ0 - 1
+	const Eigen::Vector3f boundary = simulator.getBoundingBox();
+	for (int a = 0; a < 3; a++) {
+		packRange.aabbMin[a] = 0.0f;
+		packRange.aabbMax[a] = boundary[a];
+	}
+	packRange.scalarMin = -1.0f;
+	packRange.scalarMax = 1.0f;
 	LOG_INFO << "PointRender::PointRender()";
 }
-void PointRender::setVertices(std::vector<Vertex> vertices) {
-	this->vertices = vertices;
-}
-std::vector<Vertex> PointRender::getVertices() {
-	return vertices;
-}
 void PointRender::init(){
 	LOG_INFO << "PointRender::init()";
 	m_shader = Shader(m_vertexShaderPath, m_fragmentShaderPath);
 	m_shader.use();
+	m_shader.setVec3("u_aabbMin", packRange.aabbMin[0], packRange.aabbMin[1], packRange.aabbMin[2]);
+	m_shader.setVec3("u_aabbExtent", packRange.aabbMax[0] - packRange.aabbMin[0], packRange.aabbMax[1] - packRange.aabbMin[1],
+	                 packRange.aabbMax[2] - packRange.aabbMin[2]);
+	m_shader.setVec4("u_scalarRange", packRange.scalarMin, packRange.scalarMax - packRange.scalarMin, 0.0f, 0.0f);
 
 	glGenVertexArrays(1, &VAO);
 	glGenBuffers(1, &VBO);
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
-	Vertex *verticesArray = vertices.data(); // 注意这里直接是指针，在下面的函数中，不要加取地址
+	const packed::PackedParticle *verticesArray = packedParticles.data(); // 注意这里直接是指针，在下面的函数中，不要加取地址
 	/*
 	 * parameter:
 	 * target: 缓冲的类型
@@ -45,34 +51,27 @@ void PointRender::init(){
 	 * 	GL_STREAM_DRAW: 缓冲数据每次使用一次就丢弃
 	 * 缓冲对象数据
 	 */
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), verticesArray, GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+	glBufferData(GL_ARRAY_BUFFER, sizeof(packed::PackedParticle) * packedParticles.size(), verticesArray, GL_DYNAMIC_DRAW);
+	// 归一化读取：定点数 q 在顶点着色器中为 q / 65535（位置）与 q / 255（着色通道）
+	glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(packed::PackedParticle), (void*)offsetof(packed::PackedParticle, x));
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+	glVertexAttribPointer(1, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(packed::PackedParticle), (void*)offsetof(packed::PackedParticle, scalar));
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoord));
-	glEnableVertexAttribArray(2);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
 }
 void PointRender::update(){
 //	Sleep(100);
 	simulator.runPBF();
-	vertices.clear();
-	// 预分配空间以避免多次内存分配
-	auto particles = simulator.getParticles();
+	auto particles = simulator.getParticles(); // 只读视图，不再整体拷贝粒子数组
 //	int size = simulator.getParticleNums();
-	for (int i = 0; i < particles.size(); i++){
-//	for (int i = 0; i < size; i++){
-		auto particle = particles[i];
-		vertices.push_back(Vertex::particlesToVertex(particle));
-		// 移除了重复的颜色和位置设置
-		// 移除了耗时的日志输出
-	}
-//	LOG_INFO << "PointRender::update()" << vertices.back().position << '\n';
+	// SIMD 编码为紧凑格式，上传量为原来 Vertex 的 1/6
+	packedParticles.resize(particles.size());
+	packed::encode(particles.x.data(), particles.y.data(), particles.z.data(), particles.density.data(), particles.size(),
+	               packRange, packedParticles.data());
 	// 更新顶点缓冲区数据
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * vertices.size(), vertices.data());
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(packed::PackedParticle) * packedParticles.size(), packedParticles.data());
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 void PointRender::render(){
@@ -98,11 +97,11 @@ void PointRender::render(){
 	m_shader.setMat4("view", view);
 	m_shader.setMat4("model", model);
 	glBindVertexArray(VAO);
-	glDrawArrays(GL_POINTS, 0, vertices.size());
+	glDrawArrays(GL_POINTS, 0, packedParticles.size());
 }
 
 void PointRender::destroy() {
 	glDeleteVertexArrays(1, &VAO);
 	glDeleteBuffers(1, &VBO);
 	glDeleteProgram(programID);
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include "Rendering/old_primitive_pipeline/Base/ObjectRender.h"
 #include "Rendering/Assets/fluid/CPU_process/FluidSimulator.h"
+#include "Rendering/Assets/fluid/PackedParticles.h"
 #include "Shader/Shader.h"
 
 class PointRender : public ObjectRender {
@@ -15,10 +16,11 @@ private:
 	Shader m_shader;
 	std::string m_vertexShaderPath;
 	std::string m_fragmentShaderPath;
+	// 上传紧凑粒子格式（PackedParticles.h，8 字节 / 粒子）而不是 Vertex（48 字节），顶点着色器按 packRange 解码
+	std::vector<packed::PackedParticle> packedParticles;
+	packed::Range packRange;
 public:
 	PointRender(int particleNums, std::string vertexShaderPath, std::string fragmentShaderPath);
-	void setVertices(std::vector<Vertex> vertices);
-	std::vector<Vertex> getVertices();
 
 	void init() override;
 	void render() override;
@@ -0,0 +1,60 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_COUNTERRNG_H
+#define LEARNOPENGL_COUNTERRNG_H
+
+#include <array>
+#include <cstdint>
+
+/*
+ * 基于计数器的随机数生成器（Philox4x32-10）
+ *  没有内部状态：输出只由 (计数器, 密钥) 决定，任意线程、任意顺序调用结果都相同
+ *  流体模拟中计数器取 (粒子编号, 步数, 用途, 0)，密钥取 (种子, 0)，同一种子的两次运行完全一致
+ *  Shader 中 fluidCommon.glsl 的 philox4x32() 与这里逐位相同
+ */
+namespace crng {
+
+using Counter = std::array<uint32_t, 4>;
+using Key = std::array<uint32_t, 2>;
+
+// 用途编号，避免不同用途在同一粒子、同一步上取到相同的随机数
+enum Stream : uint32_t {
+	kStreamInit = 0,     // 初始位置抖动
+	kStreamPrologue = 1, // 预测位置后的边界抖动
+	kStreamEpilogue = 2, // 迭代结束后的边界抖动
+};
+
+constexpr Counter philox4x32(Counter ctr, Key key) {
+	constexpr uint32_t kMul0 = 0xD2511F53u, kMul1 = 0xCD9E8D57u;
+	constexpr uint32_t kWeyl0 = 0x9E3779B9u, kWeyl1 = 0xBB67AE85u;
+	for (int round = 0; round < 10; round++) {
+		const uint64_t p0 = static_cast<uint64_t>(kMul0) * ctr[0];
+		const uint64_t p1 = static_cast<uint64_t>(kMul1) * ctr[2];
+		ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+		       static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0)};
+		key[0] += kWeyl0;
+		key[1] += kWeyl1;
+	}
+	return ctr;
+}
+
+// 取高 24 位映射到 [0, 1)
+constexpr float toUnitFloat(uint32_t bits) {
+	return static_cast<float>(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+// [0, 1) 内的 4 个均匀分布随机数
+constexpr std::array<float, 4> uniform4(uint32_t index, uint32_t step, uint32_t stream, uint32_t seed) {
+	const Counter bits = philox4x32({index, step, stream, 0u}, {seed, 0u});
+	return {toUnitFloat(bits[0]), toUnitFloat(bits[1]), toUnitFloat(bits[2]), toUnitFloat(bits[3])};
+}
+
+// Random123 的已知答案
+static_assert(philox4x32({0u, 0u, 0u, 0u}, {0u, 0u})[0] == 0x6627e8d5u);
+static_assert(philox4x32({0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu}, {0xffffffffu, 0xffffffffu})[0] == 0x408f276du);
+
+} // namespace crng
+
+#endif //LEARNOPENGL_COUNTERRNG_H
@@ -0,0 +1,98 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#include "MappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		close();
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+		m_file = std::exchange(other.m_file, nullptr);
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::open(const std::string& path) {
+	close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+	                          FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_data = static_cast<const std::byte*>(view);
+	m_size = static_cast<std::size_t>(size.QuadPart);
+#else
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st {};
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* view = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // 映射建立后文件描述符可以关闭
+	if (view == MAP_FAILED) return false;
+	madvise(view, static_cast<std::size_t>(st.st_size), MADV_SEQUENTIAL);
+	m_data = static_cast<const std::byte*>(view);
+	m_size = static_cast<std::size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+	if (!m_data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+	m_file = m_mapping = nullptr;
+#else
+	munmap(const_cast<std::byte*>(m_data), m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
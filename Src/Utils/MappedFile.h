@@ -0,0 +1,41 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_MAPPEDFILE_H
+#define LEARNOPENGL_MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * 只读内存映射文件
+ *  Windows 使用 CreateFileMapping / MapViewOfFile，其他平台使用 mmap
+ *  映射的起始地址按页对齐，文件内按 64 字节对齐的数据块可以直接当作数组使用
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	bool open(const std::string& path); // 失败时返回 false，之前映射的文件会被关闭
+	void close();
+
+	[[nodiscard]] const std::byte* data() const { return m_data; }
+	[[nodiscard]] std::size_t size() const { return m_size; }
+	[[nodiscard]] bool isOpen() const { return m_data != nullptr; }
+
+private:
+	const std::byte* m_data = nullptr;
+	std::size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;    // HANDLE
+	void* m_mapping = nullptr; // HANDLE
+#endif
+};
+
+#endif //LEARNOPENGL_MAPPEDFILE_H
@@ -0,0 +1,147 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#include "RansCoder.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace rans {
+
+namespace {
+
+constexpr uint32_t kLower = 1u << 23; // 状态的下界，状态始终在 [kLower, kLower << 8) 内
+
+// 把直方图缩放到和为 kProbScale，出现过的符号频率至少为 1
+void normalise(const std::array<uint32_t, 256>& counts, std::size_t n, std::array<uint32_t, 256>& freqs) {
+	uint32_t sum = 0;
+	int largest = 0;
+	for (int s = 0; s < 256; s++) {
+		freqs[s] = counts[s] ? std::max<uint32_t>(1, static_cast<uint32_t>(uint64_t(counts[s]) * kProbScale / n)) : 0;
+		sum += freqs[s];
+		if (counts[s] > counts[largest]) largest = s;
+	}
+	// 舍入误差记到出现次数最多的符号上；它的频率至少为 kProbScale / 256，足够吸收最多 256 的误差
+	if (sum < kProbScale) {
+		freqs[largest] += kProbScale - sum;
+	} else {
+		uint32_t excess = sum - kProbScale;
+		while (excess > 0) {
+			// 从当前频率最大的符号上扣除，保证频率不小于 1
+			const auto it = std::max_element(freqs.begin(), freqs.end());
+			const uint32_t take = std::min(excess, *it - 1);
+			*it -= take;
+			excess -= take;
+		}
+	}
+}
+
+template<class T>
+void put(std::vector<uint8_t>& out, T v) {
+	uint8_t bytes[sizeof(T)];
+	std::memcpy(bytes, &v, sizeof(T));
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template<class T>
+T get(const uint8_t* p) {
+	T v;
+	std::memcpy(&v, p, sizeof(T));
+	return v;
+}
+
+} // namespace
+
+void encode(const uint8_t* src, std::size_t n, std::vector<uint8_t>& out) {
+	std::array<uint32_t, 256> counts{};
+	for (std::size_t i = 0; i < n; i++) counts[src[i]]++;
+	std::array<uint32_t, 256> freqs{}, starts{};
+	if (n > 0) normalise(counts, n, freqs);
+
+	// 频率表
+	uint16_t symbols = 0;
+	for (uint32_t f : freqs) symbols += f ? 1 : 0;
+	put(out, symbols);
+	uint32_t running = 0;
+	for (int s = 0; s < 256; s++) {
+		starts[s] = running;
+		running += freqs[s];
+		if (!freqs[s]) continue;
+		out.push_back(static_cast<uint8_t>(s));
+		put(out, static_cast<uint16_t>(freqs[s]));
+	}
+	const std::size_t lengthPos = out.size();
+	put(out, uint32_t(0));
+	if (symbols <= 1) return; // 只有一种符号，解码时直接填充
+
+	// rANS 从后往前编码，输出的字节也是倒序的，最后整体翻转
+	const std::size_t begin = out.size();
+	uint32_t x = kLower;
+	for (std::size_t i = n; i-- > 0;) {
+		const uint32_t freq = freqs[src[i]];
+		const uint32_t xMax = ((kLower >> kProbBits) << 8) * freq;
+		while (x >= xMax) {
+			out.push_back(static_cast<uint8_t>(x & 0xff));
+			x >>= 8;
+		}
+		x = ((x / freq) << kProbBits) + (x % freq) + starts[src[i]];
+	}
+	for (int b = 3; b >= 0; b--) {
+		out.push_back(static_cast<uint8_t>(x >> (8 * b))); // 翻转后为小端的最终状态
+	}
+	std::reverse(out.begin() + static_cast<std::ptrdiff_t>(begin), out.end());
+	const auto payload = static_cast<uint32_t>(out.size() - begin);
+	std::memcpy(out.data() + lengthPos, &payload, sizeof(payload));
+}
+
+std::size_t decode(const uint8_t* in, std::size_t inBytes, uint8_t* dst, std::size_t n) {
+	if (inBytes < 2) return 0;
+	const uint16_t symbols = get<uint16_t>(in);
+	std::size_t pos = 2;
+	if (symbols > 256 || inBytes < pos + symbols * 3u + 4u) return 0;
+	std::array<uint32_t, 256> freqs{}, starts{};
+	uint8_t only = 0;
+	for (uint16_t k = 0; k < symbols; k++) {
+		only = in[pos];
+		freqs[in[pos]] = get<uint16_t>(in + pos + 1);
+		pos += 3;
+	}
+	const uint32_t payload = get<uint32_t>(in + pos);
+	pos += 4;
+	if (inBytes < pos + payload) return 0;
+	if (symbols <= 1) {
+		std::memset(dst, only, n);
+		return pos;
+	}
+
+	// 查找表：slot -> 符号
+	std::array<uint8_t, kProbScale> slotToSymbol{};
+	uint32_t running = 0;
+	for (int s = 0; s < 256; s++) {
+		starts[s] = running;
+		if (running + freqs[s] > kProbScale) return 0;
+		std::fill_n(slotToSymbol.begin() + running, freqs[s], static_cast<uint8_t>(s));
+		running += freqs[s];
+	}
+	if (running != kProbScale || payload < 4) return 0;
+
+	const uint8_t* p = in + pos;
+	const uint8_t* end = p + payload;
+	uint32_t x = get<uint32_t>(p);
+	p += 4;
+	for (std::size_t i = 0; i < n; i++) {
+		const uint32_t slot = x & (kProbScale - 1);
+		const uint8_t s = slotToSymbol[slot];
+		dst[i] = s;
+		x = freqs[s] * (x >> kProbBits) + slot - starts[s];
+		while (x < kLower) {
+			if (p == end) return 0;
+			x = (x << 8) | *p++;
+		}
+	}
+	return pos + payload;
+}
+
+} // namespace rans
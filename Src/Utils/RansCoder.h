@@ -0,0 +1,35 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_RANSCODER_H
+#define LEARNOPENGL_RANSCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * 按字节的 0 阶 rANS 熵编码（ryg_rans 的 32 位状态、逐字节重整化版本）
+ *  频率归一化到 2^12，每个符号编码只需一次除法，解码只需查表和乘法
+ *  输出是自描述的：非零频率表 + 码字长度 + 码字，解码时不需要额外信息
+ *  流格式：uint16 符号数 | 符号数 * (uint8 符号, uint16 频率) | uint32 码字字节数 | 码字
+ *  只有一种符号时不输出码字
+ */
+namespace rans {
+
+constexpr int kProbBits = 12;
+constexpr uint32_t kProbScale = 1u << kProbBits;
+
+// 编码 n 个字节，结果追加到 out 的末尾
+void encode(const uint8_t* src, std::size_t n, std::vector<uint8_t>& out);
+
+/*
+ * @brief: 解码 n 个字节到 dst
+ * @return: 消耗的输入字节数；输入不完整或格式错误时返回 0
+ */
+std::size_t decode(const uint8_t* in, std::size_t inBytes, uint8_t* dst, std::size_t n);
+
+} // namespace rans
+
+#endif //LEARNOPENGL_RANSCODER_H
@@ -0,0 +1,110 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadNums) {
+	if (threadNums == 0) {
+		threadNums = std::max(1u, std::thread::hardware_concurrency());
+	}
+	for (unsigned i = 0; i < threadNums; i++) {
+		m_queues.push_back(std::make_unique<Queue>());
+	}
+	// 调用线程占用最后一个队列，只需额外创建 threadNums - 1 个工作线程
+	for (unsigned i = 0; i + 1 < threadNums; i++) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_stop = true;
+	}
+	m_wakeCv.notify_all();
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const RangeFn& fn) {
+	if (begin >= end) return;
+	grain = std::max<std::size_t>(grain, 1);
+	const std::size_t chunkNums = (end - begin + grain - 1) / grain;
+	const unsigned self = size() - 1;
+	if (m_workers.empty() || chunkNums == 1) {
+		for (std::size_t b = begin; b < end; b += grain) {
+			fn(b, std::min(b + grain, end), self);
+		}
+		return;
+	}
+
+	std::atomic<std::size_t> pending{chunkNums};
+	// 每个线程分到一段连续的块
+	const unsigned threadNums = size();
+	for (unsigned t = 0; t < threadNums; t++) {
+		const std::size_t firstChunk = chunkNums * t / threadNums;
+		const std::size_t lastChunk = chunkNums * (t + 1) / threadNums;
+		std::lock_guard<std::mutex> lock(m_queues[t]->mutex);
+		for (std::size_t c = firstChunk; c < lastChunk; c++) {
+			const std::size_t b = begin + c * grain;
+			m_queues[t]->tasks.push_back({b, std::min(b + grain, end), &fn, &pending});
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_generation++;
+	}
+	m_wakeCv.notify_all();
+
+	while (runOne(self)) {}
+	// 剩下的块正在其它线程上执行
+	while (pending.load(std::memory_order_acquire) != 0) {
+		std::this_thread::yield();
+	}
+}
+
+bool ThreadPool::runOne(unsigned self) {
+	Task task{};
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(m_queues[self]->mutex);
+		auto& own = m_queues[self]->tasks;
+		if (!own.empty()) {
+			task = own.front();
+			own.pop_front();
+			found = true;
+		}
+	}
+	// 自己的队列空了，从其它线程队列的尾部窃取
+	for (unsigned k = 1; !found && k < size(); k++) {
+		auto& victim = *m_queues[(self + k) % size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			found = true;
+		}
+	}
+	if (!found) return false;
+
+	(*task.fn)(task.begin, task.end, self);
+	task.pending->fetch_sub(1, std::memory_order_release);
+	return true;
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+	std::size_t seenGeneration = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_wakeMutex);
+			m_wakeCv.wait(lock, [&] { return m_stop || m_generation != seenGeneration; });
+			if (m_stop) return;
+			seenGeneration = m_generation;
+		}
+		while (runOne(self)) {}
+	}
+}
@@ -0,0 +1,64 @@
+//
+// Created by Jingren Bai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_THREADPOOL_H
+#define LEARNOPENGL_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * 工作窃取线程池
+ *  parallelFor 把区间按 grain 切块，按线程连续分配到各线程自己的队列中（保持访存局部性），
+ *  线程先从自己队列的头部取任务，取完后从其它线程队列的尾部窃取。
+ *  调用线程也参与计算，因此 threadNums = 1 时退化为在调用线程上串行执行。
+ *  切块边界只由 grain 决定，与线程数无关，各块内的计算结果不依赖线程调度。
+ *  不支持在任务内部嵌套调用 parallelFor。
+ */
+class ThreadPool {
+public:
+	// fn(begin, end, threadIndex)，threadIndex ∈ [0, size())，可用于索引线程私有的缓冲区
+	using RangeFn = std::function<void(std::size_t, std::size_t, unsigned)>;
+
+	explicit ThreadPool(unsigned threadNums = 0); // 0 表示使用硬件线程数
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	[[nodiscard]] unsigned size() const { return static_cast<unsigned>(m_queues.size()); } // 包括调用线程
+
+	// 阻塞直到 [begin, end) 上的所有块执行完毕
+	void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, const RangeFn& fn);
+
+private:
+	struct Task {
+		std::size_t begin, end;
+		const RangeFn* fn;
+		std::atomic<std::size_t>* pending;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> m_queues; // 最后一个队列属于调用线程
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCv;
+	std::size_t m_generation = 0;
+	bool m_stop = false;
+
+	bool runOne(unsigned self); // 执行一个自己的或窃取来的任务，没有任务时返回 false
+	void workerLoop(unsigned self);
+};
+
+#endif //LEARNOPENGL_THREADPOOL_H
@@ -0,0 +1,51 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+#ifndef LEARNOPENGL_FLUIDBENCHMARKCASES_H
+#define LEARNOPENGL_FLUIDBENCHMARKCASES_H
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Rendering/Assets/fluid/Scenario.h"
+
+/*
+ * 流体求解器基准的参数矩阵：粒子数 × 初始布局，与求解器后端无关
+ *  新的后端只需要：用 positions() 初始化，先执行 settleSteps 步（不计时），再计时 measureSteps 步
+ *  固定种子，同一用例在不同后端、不同提交之间可以直接对比
+ */
+namespace bench {
+
+constexpr int kParticleCounts[] = {10000, 50000, 200000, 1000000};
+constexpr scenario::Layout kLayouts[] = {scenario::Layout::Cube, scenario::Layout::DamBreak, scenario::Layout::Pool};
+constexpr uint32_t kSeed = 0x5eedu;
+
+struct FluidCase {
+	scenario::Layout layout;
+	int particles;
+	int settleSteps; // 计时前先执行的步数：Pool 用来消除晶格初始状态的瞬态，得到静止的水池
+
+	[[nodiscard]] std::string name() const { return std::string(scenario::layoutName(layout)) + "/" + std::to_string(particles); }
+	[[nodiscard]] std::vector<Eigen::Vector3f> positions(const Eigen::Vector3f& boundaryMin, const Eigen::Vector3f& boundaryMax) const {
+		return scenario::generate(layout, particles, boundaryMin, boundaryMax, kSeed);
+	}
+};
+
+// 粒子数不超过 maxParticles 的全部用例，按粒子数从小到大；filter 非空时只保留该布局
+inline std::vector<FluidCase> fluidCases(int maxParticles, const std::string& filter = {}) {
+	std::vector<FluidCase> cases;
+	for (int n : kParticleCounts) {
+		if (n > maxParticles) continue;
+		for (scenario::Layout layout : kLayouts) {
+			if (!filter.empty() && filter != scenario::layoutName(layout)) continue;
+			cases.push_back({layout, n, layout == scenario::Layout::Pool ? 30 : 0});
+		}
+	}
+	return cases;
+}
+
+} // namespace bench
+
+#endif //LEARNOPENGL_FLUIDBENCHMARKCASES_H
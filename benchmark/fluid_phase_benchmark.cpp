@@ -0,0 +1,120 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+/*
+ * CPU 求解器分阶段基准：对 FluidBenchmarkCases.h 中的每个用例，计时 measureSteps 个完整的 PBF 步，
+ * 输出每个阶段每步的 ns/粒子（lambda / delta 为一步内全部迭代的总和）
+ *  prologue：预测位置 + 网格构建 + 邻居搜索；reorder 每 25 步一次，摊到每步
+ *
+ * 用法：FluidPhaseBenchmark [最大粒子数，默认 1000000] [计时步数，默认 10] [布局，默认全部，all 同]
+ *                           [XSPH 系数，默认 0] [涡量约束系数，默认 0] [选项...]
+ *  选项：pairs 对称邻居对遍历；cache lambda 时缓存邻居对的核函数值与梯度，位置增量直接读取
+ *  XSPH 粘性与涡量约束在 epilogue 的邻居遍历中完成，开启后的额外开销体现在 epilogue 一列
+ *  参数无法解析（如 50k、dam）或没有任何用例时打印用法并返回 2，避免夜间任务只输出表头却报告成功
+ */
+
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "FluidBenchmarkCases.h"
+#include "Rendering/Assets/fluid/CPU_process/FluidSimulator.h"
+
+namespace {
+
+void printUsage() {
+	std::fprintf(stderr, "usage: FluidPhaseBenchmark [maxParticles] [steps] [cube|dambreak|pool|all] [viscosity] "
+	                     "[vorticity] [pairs] [cache]\n");
+}
+
+// 整个参数是十进制正整数时写入 value
+bool parsePositive(const char* text, int& value) {
+	char* end = nullptr;
+	errno = 0;
+	const long v = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || errno == ERANGE || v <= 0 || v > INT_MAX) return false;
+	value = static_cast<int>(v);
+	return true;
+}
+
+// 整个参数是非负的有限浮点数时写入 value（系数为 0 表示关闭）
+bool parseCoefficient(const char* text, float& value) {
+	char* end = nullptr;
+	const float v = std::strtof(text, &end);
+	if (end == text || *end != '\0' || !std::isfinite(v) || v < 0.0f) return false;
+	value = v;
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	int maxParticles = 1000000, measureSteps = 10;
+	std::string filter; // 空表示全部布局
+	float viscosity = 0.0f, vorticity = 0.0f;
+	if ((argc > 1 && !parsePositive(argv[1], maxParticles)) || (argc > 2 && !parsePositive(argv[2], measureSteps))) {
+		std::fprintf(stderr, "particle and step counts must be positive integers\n");
+		printUsage();
+		return 2;
+	}
+	if (argc > 3 && std::string(argv[3]) != "all") {
+		scenario::Layout layout;
+		if (!scenario::parseLayout(argv[3], layout)) {
+			std::fprintf(stderr, "unknown layout: %s\n", argv[3]);
+			printUsage();
+			return 2;
+		}
+		filter = scenario::layoutName(layout);
+	}
+	if ((argc > 4 && !parseCoefficient(argv[4], viscosity)) || (argc > 5 && !parseCoefficient(argv[5], vorticity))) {
+		std::fprintf(stderr, "viscosity and vorticity must be non-negative numbers\n");
+		printUsage();
+		return 2;
+	}
+	bool symmetricPairs = false, pairCache = false;
+	for (int i = 6; i < argc; i++) {
+		const std::string option = argv[i];
+		if (option == "pairs") {
+			symmetricPairs = true;
+		} else if (option == "cache") {
+			pairCache = true;
+		} else {
+			std::fprintf(stderr, "unknown option: %s\n", option.c_str());
+			printUsage();
+			return 2;
+		}
+	}
+	const std::vector<bench::FluidCase> cases = bench::fluidCases(maxParticles, filter);
+	if (cases.empty()) {
+		std::fprintf(stderr, "no benchmark case has at most %d particles\n", maxParticles);
+		printUsage();
+		return 2;
+	}
+
+	std::printf("%-16s %10s %10s %10s %10s %10s %10s %12s\n", "case", "reorder", "prologue", "lambda", "delta",
+	            "epilogue", "total", "steps/s");
+	for (const bench::FluidCase& c : cases) {
+		Simulator sim;
+		sim.setSeed(bench::kSeed);
+		sim.setXSPHViscosity(viscosity);
+		sim.setVorticityConfinement(vorticity);
+		sim.setSymmetricPairs(symmetricPairs);
+		sim.setPairCache(pairCache);
+		sim.init(c.positions(Eigen::Vector3f::Zero(), sim.getBoundingBox()));
+		for (int i = 0; i < c.settleSteps; i++) sim.runPBF();
+		sim.resetPhaseTimings();
+		for (int i = 0; i < measureSteps; i++) sim.runPBF();
+
+		const auto& t = sim.getPhaseTimings();
+		const double scale = 1e9 / (static_cast<double>(t.steps) * c.particles); // 秒 -> 每步每粒子 ns
+		const double total = t.reorder + t.prologue + t.lambda + t.delta + t.epilogue;
+		std::printf("%-16s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %12.2f\n", c.name().c_str(), t.reorder * scale,
+		            t.prologue * scale, t.lambda * scale, t.delta * scale, t.epilogue * scale, total * scale,
+		            static_cast<double>(t.steps) / total);
+	}
+	return 0;
+}
@@ -0,0 +1,171 @@
+//
+// Created by jingrenbai on 26-10-18.
+//
+
+/*
+ * SPH 批量核函数微基准：对比标量与 AVX2 / AVX-512 实现，以及不同核函数族（标量）之间的开销
+ *  粒子位于带抖动的 0.45 间距晶格上，h = 1.1，每个粒子截取 40 个邻居（与 CPU 求解器的 maxNeighbour 一致）
+ *  输出每个粒子每次 lambda / 位置增量计算的耗时，以及与标量结果的最大误差
+ *
+ * 用法：SPHKernelBenchmark [每轴粒子数，默认 48]
+ */
+
+#include "KernelPolicy.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t kNeighbours = 40;
+constexpr float kSpacing = 0.45f;
+using DefaultKernel = sph::Poly6Spiky<>;
+constexpr float kH = DefaultKernel::h;
+
+struct Scene {
+	std::vector<float> x, y, z, lambda;
+	std::vector<uint32_t> nbr; // 每个粒子固定 kNeighbours 个
+	sph::ParticleArrays arrays() const { return {x.data(), y.data(), z.data(), lambda.data()}; }
+	std::size_t size() const { return x.size(); }
+};
+
+Scene makeScene(int side) {
+	Scene scene;
+	std::mt19937 gen(42);
+	std::uniform_real_distribution<float> jitter(-0.05f, 0.05f);
+	std::uniform_real_distribution<float> lambda(-0.5f, 0.0f);
+	const std::size_t n = static_cast<std::size_t>(side) * side * side;
+	for (std::size_t i = 0; i < n; i++) {
+		const int a = static_cast<int>(i / (side * side)), b = static_cast<int>(i / side % side), c = static_cast<int>(i % side);
+		scene.x.push_back(a * kSpacing + jitter(gen));
+		scene.y.push_back(b * kSpacing + jitter(gen));
+		scene.z.push_back(c * kSpacing + jitter(gen));
+		scene.lambda.push_back(lambda(gen));
+	}
+	// 按距离排序的晶格偏移，取最近的 kNeighbours 个；越过晶格边界时回绕，得到一些超出 h 的邻居
+	std::vector<std::array<int, 3>> offsets;
+	for (int dx = -3; dx <= 3; dx++)
+		for (int dy = -3; dy <= 3; dy++)
+			for (int dz = -3; dz <= 3; dz++)
+				if (dx || dy || dz) offsets.push_back({dx, dy, dz});
+	std::sort(offsets.begin(), offsets.end(), [](const auto& l, const auto& r) {
+		return l[0] * l[0] + l[1] * l[1] + l[2] * l[2] < r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+	});
+	offsets.resize(kNeighbours);
+	scene.nbr.reserve(n * kNeighbours);
+	for (std::size_t i = 0; i < n; i++) {
+		const int a = static_cast<int>(i / (side * side)), b = static_cast<int>(i / side % side), c = static_cast<int>(i % side);
+		for (const auto& o : offsets) {
+			const int na = (a + o[0] + side) % side, nb = (b + o[1] + side) % side, nc = (c + o[2] + side) % side;
+			scene.nbr.push_back(static_cast<uint32_t>((na * side + nb) * side + nc));
+		}
+	}
+	return scene;
+}
+
+sph::KernelConstants makeConstants() {
+	// 与 Simulator::kernelConstants() 的默认参数相同（k = 0.001，Δq = 0.3h），截断半径取 h
+	constexpr float deltaQ = 0.3f * kH;
+	return {kH, kH * kH, kH * kH, DefaultKernel::poly6Coeff, DefaultKernel::spikyCoeff, -0.001f,
+	        1.0f / DefaultKernel::w(deltaQ, deltaQ * deltaQ)};
+}
+
+template<class Kernel>
+sph::KernelDispatch scalarDispatch() {
+	return {sph::SimdLevel::Scalar, sph::lambdaBatch<Kernel>, sph::deltaBatch<Kernel>, sph::lambdaBatchCached<Kernel>,
+	        sph::deltaCachedScalar};
+}
+
+struct Result {
+	double lambdaNs, deltaNs;
+	std::vector<float> lambdaOut, deltaOut;
+};
+
+template<typename Fn>
+double timeNsPerParticle(std::size_t n, Fn&& pass) {
+	using Clock = std::chrono::steady_clock;
+	pass(); // 预热
+	int reps = 0;
+	const auto start = Clock::now();
+	auto now = start;
+	do {
+		pass();
+		reps++;
+		now = Clock::now();
+	} while (now - start < std::chrono::milliseconds(300));
+	return std::chrono::duration<double, std::nano>(now - start).count() / (static_cast<double>(reps) * n);
+}
+
+Result run(const Scene& scene, const sph::KernelDispatch& kern, const sph::KernelConstants& k) {
+	const std::size_t n = scene.size();
+	const sph::ParticleArrays p = scene.arrays();
+	Result result;
+	result.lambdaOut.resize(n * 2);
+	result.deltaOut.resize(n * 3);
+	result.lambdaNs = timeNsPerParticle(n, [&] {
+		for (std::size_t i = 0; i < n; i++) {
+			const sph::LambdaSums s = kern.lambda(p, scene.nbr.data() + i * kNeighbours, kNeighbours, p.x[i], p.y[i], p.z[i], k);
+			result.lambdaOut[i * 2] = s.density;
+			result.lambdaOut[i * 2 + 1] = s.sumSqrGrad + s.gradX * s.gradX + s.gradY * s.gradY + s.gradZ * s.gradZ;
+		}
+	});
+	result.deltaNs = timeNsPerParticle(n, [&] {
+		for (std::size_t i = 0; i < n; i++) {
+			const sph::DeltaSums s = kern.delta(p, scene.nbr.data() + i * kNeighbours, kNeighbours, p.x[i], p.y[i], p.z[i], p.lambda[i], k);
+			result.deltaOut[i * 3] = s.x;
+			result.deltaOut[i * 3 + 1] = s.y;
+			result.deltaOut[i * 3 + 2] = s.z;
+		}
+	});
+	return result;
+}
+
+// 相对于标量结果量级的最大误差
+float maxError(const std::vector<float>& ref, const std::vector<float>& out) {
+	float scale = 1e-20f, err = 0.0f;
+	for (std::size_t i = 0; i < ref.size(); i++) {
+		scale = std::max(scale, std::fabs(ref[i]));
+		err = std::max(err, std::fabs(ref[i] - out[i]));
+	}
+	return err / scale;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	const int side = argc > 1 ? std::max(4, std::atoi(argv[1])) : 48;
+	const Scene scene = makeScene(side);
+	const sph::KernelConstants k = makeConstants();
+	const sph::SimdLevel supported = sph::detectSimdLevel();
+	std::printf("particles: %zu, neighbours: %u, cpu: %s\n", scene.size(), kNeighbours, sph::simdLevelName(supported));
+	std::printf("%-8s %14s %14s %10s %10s\n", "kernel", "lambda ns/p", "delta ns/p", "speedup", "max err");
+
+	const Result scalar = run(scene, sph::selectKernels(sph::SimdLevel::Scalar), k);
+	std::printf("%-8s %14.2f %14.2f %10s %10s\n", "Scalar", scalar.lambdaNs, scalar.deltaNs, "1.00x", "-");
+	for (sph::SimdLevel level : {sph::SimdLevel::AVX2, sph::SimdLevel::AVX512}) {
+		if (static_cast<int>(level) > static_cast<int>(supported)) continue;
+		const Result simd = run(scene, sph::selectKernels(level), k);
+		const double speedup = (scalar.lambdaNs + scalar.deltaNs) / (simd.lambdaNs + simd.deltaNs);
+		const float err = std::max(maxError(scalar.lambdaOut, simd.lambdaOut), maxError(scalar.deltaOut, simd.deltaOut));
+		std::printf("%-8s %14.2f %14.2f %9.2fx %10.2e\n", sph::simdLevelName(level), simd.lambdaNs, simd.deltaNs, speedup, err);
+	}
+
+	// 各核函数族的通用标量实现，开销相对 poly6/spiky
+	std::printf("\n%-14s %14s %14s %10s\n", "family", "lambda ns/p", "delta ns/p", "relative");
+	const Result base = run(scene, scalarDispatch<DefaultKernel>(), k);
+	auto family = [&](const char* name, const sph::KernelDispatch& kern) {
+		const Result r = run(scene, kern, k);
+		std::printf("%-14s %14.2f %14.2f %9.2fx\n", name, r.lambdaNs, r.deltaNs,
+		            (r.lambdaNs + r.deltaNs) / (base.lambdaNs + base.deltaNs));
+	};
+	std::printf("%-14s %14.2f %14.2f %10s\n", sph::Poly6Spiky<kH>::name, base.lambdaNs, base.deltaNs, "1.00x");
+	family(sph::CubicSpline<kH>::name, scalarDispatch<sph::CubicSpline<kH>>());
+	family(sph::WendlandC2<kH>::name, scalarDispatch<sph::WendlandC2<kH>>());
+	return 0;
+}